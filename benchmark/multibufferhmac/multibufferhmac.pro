@@ -0,0 +1,23 @@
+# Standalone check and benchmark for the multi-buffer HMAC-MD5 kernel, not part of hifi_webrtc_relay.pro.
+# Build with: qmake benchmark/multibufferhmac/multibufferhmac.pro && make
+
+TEMPLATE = app
+TARGET = multibufferhmac_benchmark
+
+QT -= gui
+
+CONFIG += c++14 console release
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += multibufferhmacbenchmark.cpp \
+    ../../multibufferhmac.cpp
+
+HEADERS += ../../multibufferhmac.h
+
+unix:!macx:LIBS += -lcrypto
+unix:macx:LIBS += -L"/usr/local/Cellar/openssl/1.0.2o_1/lib" -lcrypto
+unix:macx:INCLUDEPATH += "/usr/local/Cellar/openssl/1.0.2o_1/include"
+win32:INCLUDEPATH +="../../resources/openssl/include"
+win32:LIBS += -L"$$PWD/../../resources/openssl/x64/lib" -llibcrypto
@@ -0,0 +1,119 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "multibufferhmac.h"
+
+using MultiBufferHMAC::MD5_DIGEST_SIZE;
+using MultiBufferHMAC::MD5_LANES;
+
+static void ReferenceHMAC(const std::vector<unsigned char>& key, const unsigned char * data, int data_len, unsigned char * digest)
+{
+    unsigned int digest_len = 0;
+    HMAC(EVP_md5(), key.data(), (int) key.size(), data, data_len, digest, &digest_len);
+}
+
+// Random keys, including ones longer than the 64 byte block that HMAC hashes first, against
+// random lengths and lane counts so the lanes of one pass run out of blocks at different times
+static bool CheckAgainstOpenSSL(int num_cases, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> key_len_dist(0, 200);
+    std::uniform_int_distribution<int> data_len_dist(0, 1500);
+    std::uniform_int_distribution<int> count_dist(1, MD5_LANES);
+    std::uniform_int_distribution<int> byte_dist(0, 255);
+
+    for (int c = 0; c < num_cases; c++) {
+        std::vector<unsigned char> key(key_len_dist(random));
+        for (unsigned char& b : key) {
+            b = (unsigned char) byte_dist(random);
+        }
+
+        MultiBufferHMAC::MD5KeyState state;
+        MultiBufferHMAC::PrepareMD5Key(key.data(), (int) key.size(), state);
+
+        const int count = count_dist(random);
+        std::vector<unsigned char> buffers[MD5_LANES];
+        const unsigned char * data[MD5_LANES];
+        int data_lens[MD5_LANES];
+        for (int i = 0; i < count; i++) {
+            buffers[i].resize(data_len_dist(random));
+            for (unsigned char& b : buffers[i]) {
+                b = (unsigned char) byte_dist(random);
+            }
+            data[i] = buffers[i].data();
+            data_lens[i] = (int) buffers[i].size();
+        }
+
+        unsigned char digests[MD5_LANES][MD5_DIGEST_SIZE];
+        MultiBufferHMAC::HMACMD5(state, data, data_lens, count, digests);
+
+        for (int i = 0; i < count; i++) {
+            unsigned char expected[MD5_DIGEST_SIZE];
+            ReferenceHMAC(key, data[i], data_lens[i], expected);
+            if (memcmp(expected, digests[i], MD5_DIGEST_SIZE) != 0) {
+                fprintf(stderr, "Mismatch in case %d lane %d of %d, key %d bytes, data %d bytes\n",
+                        c, i, count, (int) key.size(), data_lens[i]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char ** argv)
+{
+    const int num_cases = (argc > 1) ? atoi(argv[1]) : 20000;
+    const int iterations = (argc > 2) ? atoi(argv[2]) : 20000;
+
+    if (!MultiBufferHMAC::IsAvailable()) {
+        printf("AVX2 is not available on this CPU, nothing to check\n");
+        return 0;
+    }
+
+    if (!CheckAgainstOpenSSL(num_cases, 12345)) {
+        return 1;
+    }
+    printf("%d random cases match HMAC(EVP_md5())\n", num_cases);
+
+    const std::vector<unsigned char> key(16, 0x42);
+    MultiBufferHMAC::MD5KeyState state;
+    MultiBufferHMAC::PrepareMD5Key(key.data(), (int) key.size(), state);
+
+    printf("%8s %16s %16s %8s\n", "bytes", "HMAC() ns/buf", "8 lanes ns/buf", "speedup");
+    for (int size : {64, 256, 576, 1400}) {
+        std::vector<unsigned char> buffers[MD5_LANES];
+        const unsigned char * data[MD5_LANES];
+        int data_lens[MD5_LANES];
+        for (int i = 0; i < MD5_LANES; i++) {
+            buffers[i].assign(size, (unsigned char) i);
+            data[i] = buffers[i].data();
+            data_lens[i] = size;
+        }
+        unsigned char digests[MD5_LANES][MD5_DIGEST_SIZE];
+
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            for (int i = 0; i < MD5_LANES; i++) {
+                ReferenceHMAC(key, data[i], data_lens[i], digests[i]);
+            }
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            MultiBufferHMAC::HMACMD5(state, data, data_lens, MD5_LANES, digests);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        const double reference_ns = std::chrono::duration<double, std::nano>(middle - start).count() / (iterations * MD5_LANES);
+        const double lanes_ns = std::chrono::duration<double, std::nano>(end - middle).count() / (iterations * MD5_LANES);
+        printf("%8d %16.1f %16.1f %7.1fx\n", size, reference_ns, lanes_ns, reference_ns / lanes_ns);
+    }
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+# Standalone benchmark for the packet obfuscation kernel, not part of hifi_webrtc_relay.pro.
+# Build with: qmake benchmark/obfuscation/obfuscation.pro && make
+
+TEMPLATE = app
+TARGET = obfuscation_benchmark
+
+CONFIG += c++14 console release
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../..
+
+SOURCES += obfuscationbenchmark.cpp \
+    ../../obfuscation.cpp
+
+HEADERS += ../../obfuscation.h
@@ -0,0 +1,76 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "obfuscation.h"
+
+// The byte-at-a-time loop Packet::Obfuscate used before Obfuscation::XorInPlace
+static void XorReference(char * data, int size, uint64_t key)
+{
+    auto xor_value = reinterpret_cast<const char*>(&key);
+    for (int i = 0; i < size; ++i) {
+        *(data++) ^= *(xor_value + (i % sizeof(uint64_t)));
+    }
+}
+
+static bool CheckAgainstReference(uint64_t key)
+{
+    std::vector<char> expected(300 + 32);
+    std::vector<char> actual(300 + 32);
+
+    for (int offset = 0; offset < 32; offset++) {
+        for (int size = 0; size <= 300; size++) {
+            for (int i = 0; i < size; i++) {
+                expected[offset + i] = actual[offset + i] = (char) (i * 31 + offset);
+            }
+
+            XorReference(expected.data() + offset, size, key);
+            Obfuscation::XorInPlace(actual.data() + offset, size, key);
+
+            if (memcmp(expected.data() + offset, actual.data() + offset, size) != 0) {
+                fprintf(stderr, "Mismatch at offset %d size %d\n", offset, size);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Function>
+static double NanosecondsPerCall(Function xor_function, int size, int iterations, uint64_t key)
+{
+    std::vector<char> buffer(size, 0x5A);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        xor_function(buffer.data(), size, key);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    // Keep the result alive so the loop cannot be dropped
+    volatile char sink = buffer[size / 2];
+    (void) sink;
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+int main(int argc, char ** argv)
+{
+    const int iterations = (argc > 1) ? atoi(argv[1]) : 200000;
+    const uint64_t key = 0x6362726184736e6bULL;
+
+    if (!CheckAgainstReference(key)) {
+        return 1;
+    }
+
+    printf("%8s %14s %14s %8s\n", "bytes", "byte loop ns", "XorInPlace ns", "speedup");
+    for (int size : {16, 64, 256, 576, 1024, 1400}) {
+        const double reference_ns = NanosecondsPerCall(XorReference, size, iterations, key);
+        const double kernel_ns = NanosecondsPerCall(Obfuscation::XorInPlace, size, iterations, key);
+        printf("%8d %14.1f %14.1f %7.1fx\n", size, reference_ns, kernel_ns, reference_ns / kernel_ns);
+    }
+
+    return 0;
+}
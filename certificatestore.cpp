@@ -0,0 +1,78 @@
+#include "certificatestore.h"
+
+#include <QDebug>
+#include <QFile>
+
+CertificateStore& CertificateStore::Instance()
+{
+    static CertificateStore store;
+    return store;
+}
+
+CertificateStore::CertificateStore()
+{
+    connect(&rotation_timer, &QTimer::timeout, this, &CertificateStore::Rotate);
+}
+
+void CertificateStore::SetCertificateFiles(const QString& cert, const QString& key)
+{
+    cert_path = cert;
+    key_path = key;
+}
+
+bool CertificateStore::Start()
+{
+    Rotate();
+    rotation_timer.start(ROTATION_INTERVAL_MSEC);
+    return GetCertificate() != nullptr;
+}
+
+std::shared_ptr<const rtcdcpp::RTCCertificate> CertificateStore::GetCertificate()
+{
+    QMutexLocker lock(&mutex);
+    return certificate;
+}
+
+void CertificateStore::Rotate()
+{
+    std::shared_ptr<const rtcdcpp::RTCCertificate> new_certificate = cert_path.isEmpty() ? GenerateCertificate() : LoadCertificate();
+    if (!new_certificate) {
+        // Keep presenting the current one, it is still valid for a good while
+        qWarning() << "CertificateStore::Rotate() - No new certificate, keeping the current one";
+        return;
+    }
+
+    qDebug() << "CertificateStore::Rotate() - Using certificate with fingerprint" << QString::fromStdString(new_certificate->fingerprint());
+
+    QMutexLocker lock(&mutex);
+    certificate = new_certificate;
+}
+
+std::shared_ptr<const rtcdcpp::RTCCertificate> CertificateStore::LoadCertificate()
+{
+    QFile cert_file(cert_path);
+    QFile key_file(key_path);
+    if (!cert_file.open(QIODevice::ReadOnly) || !key_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "CertificateStore::LoadCertificate() - Could not open" << cert_path << "or" << key_path;
+        return nullptr;
+    }
+
+    try {
+        return std::make_shared<const rtcdcpp::RTCCertificate>(cert_file.readAll().toStdString(), key_file.readAll().toStdString());
+    }
+    catch (const std::exception& e) {
+        qWarning() << "CertificateStore::LoadCertificate() - Could not read certificate:" << e.what();
+        return nullptr;
+    }
+}
+
+std::shared_ptr<const rtcdcpp::RTCCertificate> CertificateStore::GenerateCertificate()
+{
+    try {
+        return std::make_shared<const rtcdcpp::RTCCertificate>(rtcdcpp::RTCCertificate::GenerateECDSACertificate("hifi_webrtc_relay", CERTIFICATE_VALIDITY_DAYS));
+    }
+    catch (const std::exception& e) {
+        qWarning() << "CertificateStore::GenerateCertificate() - Could not generate certificate:" << e.what();
+        return nullptr;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef CERTIFICATESTORE_H
+#define CERTIFICATESTORE_H
+
+#include <memory>
+
+#include <QObject>
+#include <QMutex>
+#include <QTimer>
+
+#include <rtcdcpp/RTCCertificate.hpp>
+
+// The one DTLS certificate every peer connection presents. Without it each offer made the library generate
+// an RSA key and self-signed certificate of its own on the worker thread.
+//
+// Either loaded from PEM files (-certificate cert key) or an ECDSA P-256 certificate generated at startup.
+// Rotated every ROTATION_INTERVAL_MSEC: generated certificates are replaced, loaded ones are read from disk
+// again so renewed files are picked up. Peers keep the certificate they started with.
+class CertificateStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int CERTIFICATE_VALIDITY_DAYS = 30;
+    static const int ROTATION_INTERVAL_MSEC = 24 * 60 * 60 * 1000;
+
+    // The first call decides which thread rotates, make it from the main thread at startup
+    static CertificateStore& Instance();
+
+    void SetCertificateFiles(const QString& cert, const QString& key);
+
+    // Loads or generates the first certificate and starts rotating
+    bool Start();
+
+    // Safe to call from any thread, null only before Start() succeeded
+    std::shared_ptr<const rtcdcpp::RTCCertificate> GetCertificate();
+
+private Q_SLOTS:
+
+    void Rotate();
+
+private:
+    CertificateStore();
+
+    std::shared_ptr<const rtcdcpp::RTCCertificate> LoadCertificate();
+    std::shared_ptr<const rtcdcpp::RTCCertificate> GenerateCertificate();
+
+    QMutex mutex;
+    std::shared_ptr<const rtcdcpp::RTCCertificate> certificate;
+
+    QString cert_path;
+    QString key_path;
+
+    QTimer rotation_timer;
+};
+
+#endif // CERTIFICATESTORE_H
@@ -0,0 +1,148 @@
+#include "connectionworker.h"
+
+ConnectionWorker::ConnectionWorker(int id) :
+    worker_id(id),
+    num_connections(0),
+    stats_timer(nullptr)
+{
+    qRegisterMetaType<qintptr>("qintptr");
+
+    // A child, so it follows the worker to its thread
+    websocket_server = new QWebSocketServer(QStringLiteral("Signaling Server"), QWebSocketServer::NonSecureMode, this);
+    connect(websocket_server, &QWebSocketServer::newConnection, this, &ConnectionWorker::CreateConnections);
+    connect(websocket_server, &QWebSocketServer::serverError, this, &ConnectionWorker::HandshakeFailed);
+}
+
+ConnectionWorker::~ConnectionWorker()
+{
+
+}
+
+void ConnectionWorker::AssignConnection(qintptr socket_descriptor)
+{
+    // Count it now so the next assignment already sees this worker's new load
+    num_connections.ref();
+
+    QMetaObject::invokeMethod(this, "AcceptConnection", Qt::QueuedConnection, Q_ARG(qintptr, socket_descriptor));
+}
+
+void ConnectionWorker::AcceptConnection(qintptr socket_descriptor)
+{
+    // Sockets are created on the thread that uses them, QWebSocketServer takes this one over
+    QTcpSocket * tcp_socket = new QTcpSocket();
+    if (!tcp_socket->setSocketDescriptor(socket_descriptor)) {
+        qDebug() << "ConnectionWorker::AcceptConnection() - Worker" << worker_id << "could not take socket" << socket_descriptor << tcp_socket->errorString();
+        delete tcp_socket;
+        num_connections.deref();
+        return;
+    }
+
+    websocket_server->handleConnection(tcp_socket);
+}
+
+void ConnectionWorker::HandshakeFailed(QWebSocketProtocol::CloseCode close_code)
+{
+    // The socket never becomes a connection, give back the load counted for it
+    qDebug() << "ConnectionWorker::HandshakeFailed() - Worker" << worker_id << websocket_server->errorString() << close_code;
+    num_connections.deref();
+}
+
+void ConnectionWorker::CreateConnections()
+{
+    while (websocket_server->hasPendingConnections()) {
+        CreateConnection(websocket_server->nextPendingConnection());
+    }
+}
+
+void ConnectionWorker::CreateConnection(QWebSocket * s)
+{
+    HifiConnection * h = new HifiConnection(s);
+    connect(h, SIGNAL(Disconnected()), this, SLOT(DisconnectHifiConnection()), Qt::QueuedConnection);
+    hifi_connections.push_back(h);
+
+    // Created on first use so it belongs to the worker thread
+    if (!stats_timer) {
+        stats_timer = new QTimer(this);
+        connect(stats_timer, &QTimer::timeout, this, &ConnectionWorker::LogStats);
+        stats_timer->start(STATS_INTERVAL_MSEC);
+    }
+}
+
+void ConnectionWorker::DisconnectHifiConnection()
+{
+    HifiConnection *s = qobject_cast<HifiConnection *>(sender());
+    if (hifi_connections.contains(s)) {
+        hifi_connections.removeAll(s);
+        num_connections.deref();
+        qDebug() << "ConnectionWorker::DisconnectHifiConnection() - Worker" << worker_id << s << "Connections:" << num_connections.load();
+
+        const ConnectionFootprint footprint = s->GetMemoryFootprint();
+        qDebug() << "ConnectionWorker::DisconnectHifiConnection() - Connection footprint" << footprint.GetTotal() << "bytes, Connection:" << footprint.connection
+                 << "Setup:" << footprint.setup << "Nodes:" << footprint.nodes << "Send batch:" << footprint.send_batch;
+
+        s->Stop();
+        s->disconnect();
+
+        LogStats();
+        //s->deleteLater();
+    }
+}
+
+void ConnectionWorker::LogStats()
+{
+    // Live connections, so growth shows up while clients are still connected rather than when they leave
+    size_t largest = 0;
+    const ConnectionFootprint footprint = GetMemoryFootprint(&largest);
+    const int num_live = hifi_connections.size();
+    qDebug() << "ConnectionWorker::LogStats() - Worker" << worker_id << num_live << "connections hold" << footprint.GetTotal()
+             << "bytes, Per connection:" << ((num_live > 0) ? footprint.GetTotal() / num_live : 0) << "Largest:" << largest
+             << "Connection:" << footprint.connection << "Setup:" << footprint.setup << "Nodes:" << footprint.nodes << "Send batch:" << footprint.send_batch;
+
+    // The pool is shared by every connection in the process
+    const rtcdcpp::ChunkPoolStats pool_stats = rtcdcpp::ChunkPool::GetStats();
+    for (int i = 0; i < (int) pool_stats.size_classes.size(); i++) {
+        const rtcdcpp::ChunkPoolStats::SizeClass & size_class = pool_stats.size_classes[i];
+        qDebug() << "ConnectionWorker::LogStats() - Chunk pool" << size_class.chunk_size << "bytes, Hits:" << size_class.hits
+                 << "Misses:" << size_class.misses << "Blocks:" << size_class.blocks << "Peak blocks:" << size_class.peak_blocks;
+    }
+    qDebug() << "ConnectionWorker::LogStats() - Chunk pool unpooled chunks:" << pool_stats.unpooled;
+
+    const MetaverseClient& metaverse_client = MetaverseClient::ForCurrentThread();
+    qDebug() << "ConnectionWorker::LogStats() - Metaverse requests:" << metaverse_client.GetNumRequests()
+             << "In flight:" << metaverse_client.GetNumInFlight() << "Failed:" << metaverse_client.GetNumFailed()
+             << "Timed out:" << metaverse_client.GetNumTimedOut() << "Average latency:" << metaverse_client.GetAverageLatencyMsec()
+             << "ms Max latency:" << metaverse_client.GetMaxLatencyMsec() << "ms";
+
+    const PlaceLookupCache& place_cache = PlaceLookupCache::Instance();
+    qDebug() << "ConnectionWorker::LogStats() - Place lookups, Hits:" << place_cache.GetNumHits()
+             << "Stale hits:" << place_cache.GetNumStaleHits() << "Coalesced:" << place_cache.GetNumCoalesced()
+             << "Fetches:" << place_cache.GetNumFetches();
+}
+
+ConnectionFootprint ConnectionWorker::GetMemoryFootprint(size_t * largest_connection)
+{
+    ConnectionFootprint total = {0, 0, 0, 0};
+    for (int i = 0; i < hifi_connections.size(); i++) {
+        const ConnectionFootprint footprint = hifi_connections[i]->GetMemoryFootprint();
+        total.connection += footprint.connection;
+        total.setup += footprint.setup;
+        total.nodes += footprint.nodes;
+        total.send_batch += footprint.send_batch;
+        if (largest_connection) {
+            *largest_connection = qMax(*largest_connection, footprint.GetTotal());
+        }
+    }
+    return total;
+}
+
+void ConnectionWorker::StopConnections()
+{
+    for (int i = 0; i < hifi_connections.size(); i++)
+    {
+        hifi_connections[i]->Stop();
+        hifi_connections[i]->disconnect();
+        delete hifi_connections[i];
+    }
+    hifi_connections.clear();
+    num_connections.store(0);
+}
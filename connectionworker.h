@@ -0,0 +1,59 @@
+#ifndef CONNECTIONWORKER_H
+#define CONNECTIONWORKER_H
+
+#include <QObject>
+#include <QtWebSockets>
+#include <QDebug>
+#include <QThread>
+#include <QTimer>
+#include <QAtomicInt>
+
+#include "hificonnection.h"
+
+// Owns the HifiConnections of one worker thread. Everything a connection creates (sockets, timers)
+// lives in this thread's event loop, so connections on different workers never contend.
+class ConnectionWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    ConnectionWorker(int id);
+    ~ConnectionWorker();
+
+    int GetId() const {return worker_id;}
+    int GetNumConnections() const {return num_connections.load();}
+
+    // Called from the thread that accepted the socket. The WebSocket handshake and everything after it
+    // happen on this worker's thread.
+    void AssignConnection(qintptr socket_descriptor);
+
+    // Sum over this worker's connections, call from the worker thread. Optionally raises
+    // *largest_connection to the total of the biggest one.
+    ConnectionFootprint GetMemoryFootprint(size_t * largest_connection = nullptr);
+
+public Q_SLOTS:
+
+    void AcceptConnection(qintptr socket_descriptor);
+    void CreateConnections();
+    void HandshakeFailed(QWebSocketProtocol::CloseCode close_code);
+    void DisconnectHifiConnection();
+    void StopConnections();
+    void LogStats();
+
+private:
+    void CreateConnection(QWebSocket * s);
+
+    // How often live connections report their memory, along with the shared pools
+    static const int STATS_INTERVAL_MSEC = 60 * 1000;
+
+    int worker_id;
+    QAtomicInt num_connections;
+    QTimer * stats_timer;
+
+    // Never listens, it only upgrades the sockets assigned to this worker
+    QWebSocketServer * websocket_server;
+
+    QList<HifiConnection *> hifi_connections;
+};
+
+#endif // CONNECTIONWORKER_H
@@ -0,0 +1,195 @@
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <QDebug>
+
+#include "datagrambatch.h"
+
+QThreadStorage<DatagramReceiveBatch *> DatagramReceiveBatch::thread_batches;
+
+DatagramReceiveBatch& DatagramReceiveBatch::ForCurrentThread()
+{
+    if (!thread_batches.hasLocalData()) {
+        thread_batches.setLocalData(new DatagramReceiveBatch());
+    }
+    return *thread_batches.localData();
+}
+
+DatagramReceiveBatch::DatagramReceiveBatch()
+{
+    memset(sizes, 0, sizeof(sizes));
+    memset(truncated, 0, sizeof(truncated));
+    memset(senders, 0, sizeof(senders));
+
+#ifdef Q_OS_LINUX
+    // The headers point at fixed buffers, so they are set up once and only the lengths are refreshed per call
+    memset(headers, 0, sizeof(headers));
+    for (int i = 0; i < MAX_DATAGRAMS; i++) {
+        iovecs[i].iov_base = buffers[i];
+        iovecs[i].iov_len = MAX_DATAGRAM_SIZE;
+
+        headers[i].msg_hdr.msg_name = &senders[i];
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+}
+
+#ifdef Q_OS_LINUX
+int DatagramReceiveBatch::Receive(qintptr socket_descriptor)
+{
+    for (int i = 0; i < MAX_DATAGRAMS; i++) {
+        headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        headers[i].msg_hdr.msg_flags = 0;
+    }
+
+    int num_received;
+    do {
+        num_received = recvmmsg((int) socket_descriptor, headers, MAX_DATAGRAMS, MSG_DONTWAIT, nullptr);
+    } while (num_received < 0 && errno == EINTR);
+
+    if (num_received < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            qDebug() << "DatagramReceiveBatch::Receive() - recvmmsg failed:" << strerror(errno);
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < num_received; i++) {
+        sizes[i] = (int) headers[i].msg_len;
+        truncated[i] = (headers[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    }
+
+    return num_received;
+}
+#endif
+
+DatagramSendBatch::DatagramSendBatch()
+{
+    num_flushes = 0;
+    num_datagrams = 0;
+    num_dropped = 0;
+    max_batch_size = 0;
+}
+
+DatagramSendBatch::EnqueueResult DatagramSendBatch::Enqueue(const char * data, int len, const sockaddr_in& address)
+{
+    QMutexLocker lock(&queue_mutex);
+
+    Entry entry;
+    entry.offset = (int) pending.arena.size();
+    entry.length = len;
+    entry.address = address;
+
+    pending.arena.insert(pending.arena.end(), data, data + len);
+    pending.entries.push_back(entry);
+
+    const int num_entries = (int) pending.entries.size();
+    if (num_entries % MAX_DATAGRAMS == 0) {
+        return BatchFull;
+    }
+    return (num_entries == 1) ? FirstInBatch : Queued;
+}
+
+void DatagramSendBatch::Flush(qintptr socket_descriptor)
+{
+    QMutexLocker flush_lock(&flush_mutex);
+
+    {
+        // Swap the buffers so senders keep queueing while this batch goes out
+        QMutexLocker lock(&queue_mutex);
+        if (pending.entries.empty()) {
+            return;
+        }
+        std::swap(pending, sending);
+    }
+
+    const int num_entries = (int) sending.entries.size();
+    for (int first = 0; first < num_entries; ) {
+        const int count = std::min(num_entries - first, (int) MAX_DATAGRAMS);
+        const int num_sent = SendEntries(socket_descriptor, sending, first, count);
+
+        ++num_flushes;
+        num_datagrams += num_sent;
+        max_batch_size = std::max(max_batch_size, num_sent);
+
+        if (num_sent < count) {
+            // The datagram we stopped at could not be written, drop it and carry on with the rest
+            ++num_dropped;
+            first += num_sent + 1;
+        }
+        else {
+            first += count;
+        }
+    }
+
+    sending.arena.clear();
+    sending.entries.clear();
+}
+
+void DatagramSendBatch::Trim()
+{
+    QMutexLocker flush_lock(&flush_mutex);
+    QMutexLocker lock(&queue_mutex);
+
+    // sending is always empty outside Flush, pending only when nothing is queued
+    if (sending.arena.capacity() > RETAINED_ARENA_SIZE) {
+        std::vector<char>().swap(sending.arena);
+    }
+    if (pending.entries.empty() && pending.arena.capacity() > RETAINED_ARENA_SIZE) {
+        std::vector<char>().swap(pending.arena);
+    }
+}
+
+size_t DatagramSendBatch::GetAllocatedBytes()
+{
+    QMutexLocker flush_lock(&flush_mutex);
+    QMutexLocker lock(&queue_mutex);
+
+    return pending.arena.capacity() + sending.arena.capacity()
+        + (pending.entries.capacity() + sending.entries.capacity()) * sizeof(Entry);
+}
+
+int DatagramSendBatch::SendEntries(qintptr socket_descriptor, const Batch& batch, int first, int count)
+{
+#ifdef Q_OS_LINUX
+    mmsghdr headers[MAX_DATAGRAMS];
+    iovec iovecs[MAX_DATAGRAMS];
+    memset(headers, 0, sizeof(mmsghdr) * count);
+
+    for (int i = 0; i < count; i++) {
+        const Entry& entry = batch.entries[first + i];
+        iovecs[i].iov_base = const_cast<char *>(batch.arena.data() + entry.offset);
+        iovecs[i].iov_len = entry.length;
+
+        headers[i].msg_hdr.msg_name = const_cast<sockaddr_in *>(&entry.address);
+        headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int num_sent = 0;
+    while (num_sent < count) {
+        int result = sendmmsg((int) socket_descriptor, headers + num_sent, count - num_sent, MSG_DONTWAIT);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qDebug() << "DatagramSendBatch::SendEntries() - sendmmsg failed:" << strerror(errno);
+            break;
+        }
+        num_sent += result;
+    }
+    return num_sent;
+#else
+    for (int i = 0; i < count; i++) {
+        const Entry& entry = batch.entries[first + i];
+        if (::sendto(socket_descriptor, batch.arena.data() + entry.offset, entry.length, 0,
+                     reinterpret_cast<const sockaddr *>(&entry.address), sizeof(entry.address)) < 0) {
+            return i;
+        }
+    }
+    return count;
+#endif
+}
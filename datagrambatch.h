@@ -0,0 +1,115 @@
+#ifndef DATAGRAMBATCH_H
+#define DATAGRAMBATCH_H
+
+#include <vector>
+
+#include <QtGlobal>
+#include <QThreadStorage>
+#include <QMutex>
+
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#include <WS2tcpip.h>
+#endif //Q_OS_WIN
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif //Q_OS_UNIX
+
+// Preallocated MTU sized receive buffers. On Linux a whole batch is drained from a socket with a single recvmmsg call.
+// Buffers are only used for the duration of one readyRead, so one batch is shared by every connection on a thread.
+class DatagramReceiveBatch
+{
+public:
+    static const int MAX_DATAGRAMS = 64;
+    static const int MAX_DATAGRAM_SIZE = 1500;
+
+    static DatagramReceiveBatch& ForCurrentThread();
+
+#ifdef Q_OS_LINUX
+    // Returns the number of datagrams read without blocking, 0 when the socket is empty.
+    int Receive(qintptr socket_descriptor);
+#endif
+
+    char * GetData(int i) {return buffers[i];}
+    int GetSize(int i) const {return sizes[i];}
+    quint32 GetSenderIPv4(int i) const {return ntohl(senders[i].sin_addr.s_addr);}
+    quint16 GetSenderPort(int i) const {return ntohs(senders[i].sin_port);}
+    bool IsTruncated(int i) const {return truncated[i];}
+
+private:
+    DatagramReceiveBatch();
+
+    static QThreadStorage<DatagramReceiveBatch *> thread_batches;
+
+    char buffers[MAX_DATAGRAMS][MAX_DATAGRAM_SIZE];
+    int sizes[MAX_DATAGRAMS];
+    bool truncated[MAX_DATAGRAMS];
+    sockaddr_in senders[MAX_DATAGRAMS];
+
+#ifdef Q_OS_LINUX
+    mmsghdr headers[MAX_DATAGRAMS];
+    iovec iovecs[MAX_DATAGRAMS];
+#endif
+};
+
+// Outgoing datagrams gathered over one burst and written with a single sendmmsg on Linux.
+// Enqueue may be called from any thread; the first datagram of a batch tells the caller to schedule a flush,
+// and so does every MAX_DATAGRAMS more queued behind it. Flush must run on the thread that owns the socket.
+// Datagrams are copied into an arena that keeps its capacity between batches.
+class DatagramSendBatch
+{
+public:
+    static const int MAX_DATAGRAMS = 64;
+
+    enum EnqueueResult {
+        FirstInBatch,
+        Queued,
+        BatchFull
+    };
+
+    DatagramSendBatch();
+
+    EnqueueResult Enqueue(const char * data, int len, const sockaddr_in& address);
+    void Flush(qintptr socket_descriptor);
+
+    // Gives back arena capacity above RETAINED_ARENA_SIZE, so a past burst does not stay allocated on an idle connection
+    void Trim();
+    size_t GetAllocatedBytes();
+
+    quint64 GetNumFlushes() const {return num_flushes;}
+    quint64 GetNumDatagrams() const {return num_datagrams;}
+    quint64 GetNumDropped() const {return num_dropped;}
+    int GetMaxBatchSize() const {return max_batch_size;}
+
+private:
+    static const size_t RETAINED_ARENA_SIZE = 4 * 1024;
+
+    struct Entry
+    {
+        int offset;
+        int length;
+        sockaddr_in address;
+    };
+
+    struct Batch
+    {
+        std::vector<char> arena;
+        std::vector<Entry> entries;
+    };
+
+    int SendEntries(qintptr socket_descriptor, const Batch& batch, int first, int count);
+
+    QMutex queue_mutex;
+    QMutex flush_mutex;
+    Batch pending;
+    Batch sending;
+
+    quint64 num_flushes;
+    quint64 num_datagrams;
+    quint64 num_dropped;
+    int max_batch_size;
+};
+
+#endif // DATAGRAMBATCH_H
@@ -1,7 +1,7 @@
 QT -= gui
 QT += network websockets
 
-CONFIG += c++11 console
+CONFIG += c++14 console
 CONFIG -= app_bundle
 
 QMAKE_MACOSX_DEPLOYMENT_TARGET=10.9
@@ -20,21 +20,47 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += main.cpp \
     task.cpp \
     packet.cpp \
+    packetview.cpp \
+    obfuscation.cpp \
     utils.cpp \
     node.cpp \
+    noderoutingtable.cpp \
+    datagrambatch.cpp \
+    messageframing.cpp \
     hmacauth.cpp \
+    multibufferhmac.cpp \
     hificonnection.cpp \
-    rsakeypairgenerator.cpp
+    connectionworker.cpp \
+    metaverseclient.cpp \
+    placelookupcache.cpp \
+    hostresolvercache.cpp \
+    rsakeypairgenerator.cpp \
+    rsakeypairpool.cpp \
+    certificatestore.cpp \
+    signalingserver.cpp
 
 HEADERS += \
     task.h \
     packet.h \
+    packetview.h \
+    obfuscation.h \
     utils.h \
     node.h \
+    noderoutingtable.h \
+    datagrambatch.h \
+    messageframing.h \
     hmacauth.h \
+    multibufferhmac.h \
     portableendian.h \
     hificonnection.h \
-    rsakeypairgenerator.h
+    connectionworker.h \
+    metaverseclient.h \
+    placelookupcache.h \
+    hostresolvercache.h \
+    rsakeypairgenerator.h \
+    rsakeypairpool.h \
+    certificatestore.h \
+    signalingserver.h
 
 INCLUDEPATH +="./resources/librtcdcpp/include"
 unix:!macx:LIBS += -L"$$PWD/resources/librtcdcpp/lib/linux" -lrtcdcpp
@@ -4,40 +4,42 @@
 
 HifiConnection::HifiConnection(QWebSocket * s)
 {
-    username = "";
-    password = "";
-    keypair_generator = new RSAKeypairGenerator();
-    waiting_for_keypair = false;
-    token = "";
-
-    domain_name = "";
+    setup.reset(new ConnectionSetup());
+    setup->bring_up_timer.start();
+    setup->stun_finished = false;
+    setup->started_ice = false;
+    setup->ice_finished = false;
+    setup->username = "";
+    setup->password = "";
+    setup->taking_keypair = false;
+    setup->waiting_for_keypair = false;
+    setup->signing_username = false;
+    setup->token = "";
+    setup->expiryTimestamp = 0;
+
+    setup->domain_name = "";
     domain_place_name = "";
     domain_id = QUuid();
     finished_domain_id_request = false;
-    stun_server_hostname = "stun.highfidelity.io";
-    stun_server_address = QHostAddress();
-    stun_server_port = 3478;
-    ice_server_hostname = "ice.highfidelity.com"; //"dev-ice.highfidelity.com";
-
-    qDebug() << "HifiConnection::HifiConnection() - Synchronously looking up IP address for hostname" << stun_server_hostname;
-    QHostInfo result_stun = QHostInfo::fromName(stun_server_hostname);
-    HandleLookupResult(result_stun, "stun");
-    //qDebug() << "HifiConnection::HifiConnection() - STUN server IP address: " << stun_server_hostname;
+    setup->stun_server_hostname = HIFI_STUN_SERVER_HOSTNAME;
+    stun_server_port = HIFI_STUN_SERVER_PORT;
+    setup->ice_server_hostname = HIFI_ICE_SERVER_HOSTNAME;
 
-    qDebug() << "HifiConnection::HifiConnection() - Synchronously looking up IP address for hostname" << ice_server_hostname;
-    QHostInfo result_ice = QHostInfo::fromName(ice_server_hostname);
-    HandleLookupResult(result_ice, "ice");
-    //qDebug() << "HifiConnection::HifiConnection() - ICE server IP address: " << ice_server_hostname;
+    // Take whatever the resolver cache has now, never wait on DNS here. SendStunRequest() and
+    // SendIceRequest() ask again for a server that has not resolved yet.
+    stun_server_address = HostResolverCache::Instance().GetAddress(setup->stun_server_hostname);
 
     ice_server_address = Utils::GetDefaultIceServerAddress();
+    if (ice_server_address.isNull()) {
+        ice_server_address = HostResolverCache::Instance().GetAddress(setup->ice_server_hostname);
+    }
     ice_server_port = Utils::GetDefaultIceServerPort();
 
     has_tcp_checked_local_socket = false;
     UpdateLocalSocket();
 
-    connect(this, SIGNAL(WebRTCConnectionReady()), this, SLOT(StartStun()));
-    connect(this, SIGNAL(StunFinished()), this, SLOT(StartIce()));
-    connect(this, SIGNAL(IceFinished()), this, SLOT(StartDomainConnect()));
+    connect(this, SIGNAL(StunFinished()), this, SLOT(AdvanceBringUp()));
+    connect(this, SIGNAL(IceFinished()), this, SLOT(AdvanceBringUp()));
 
     ice_client_id = QUuid::createUuid();
 
@@ -48,25 +50,20 @@ HifiConnection::HifiConnection(QWebSocket * s)
 
     domain_connected = false;
 
-    asset_server = nullptr;
-    audio_mixer = nullptr;
-    avatar_mixer = nullptr;
-    messages_mixer = nullptr;
-    entity_server = nullptr;
-    entity_script_server = nullptr;
     data_channel = nullptr;
+    client_framing_enabled = false;
 
-    stun_response_timer = new QTimer { this };
-    connect(stun_response_timer, &QTimer::timeout, this, &HifiConnection::SendStunRequest);
-    stun_response_timer->setInterval(HIFI_INITIAL_UPDATE_INTERVAL_MSEC); // 250ms, Qt::CoarseTimer acceptable
+    setup->stun_response_timer = new QTimer { this };
+    connect(setup->stun_response_timer, &QTimer::timeout, this, &HifiConnection::SendStunRequest);
+    setup->stun_response_timer->setInterval(HIFI_INITIAL_UPDATE_INTERVAL_MSEC); // 250ms, Qt::CoarseTimer acceptable
 
-    ice_response_timer = new QTimer { this };
-    connect(ice_response_timer, &QTimer::timeout, this, &HifiConnection::SendIceRequest);
-    ice_response_timer->setInterval(HIFI_INITIAL_UPDATE_INTERVAL_MSEC); // 250ms, Qt::CoarseTimer acceptable
+    setup->ice_response_timer = new QTimer { this };
+    connect(setup->ice_response_timer, &QTimer::timeout, this, &HifiConnection::SendIceRequest);
+    setup->ice_response_timer->setInterval(HIFI_INITIAL_UPDATE_INTERVAL_MSEC); // 250ms, Qt::CoarseTimer acceptable
 
-    hifi_response_timer = new QTimer { this };
-    connect(hifi_response_timer, &QTimer::timeout, this, &HifiConnection::SendDomainCheckIn);
-    hifi_response_timer->setInterval(HIFI_INITIAL_UPDATE_INTERVAL_MSEC); // 250ms, Qt::CoarseTimer acceptable
+    setup->hifi_response_timer = new QTimer { this };
+    connect(setup->hifi_response_timer, &QTimer::timeout, this, &HifiConnection::SendDomainCheckIn);
+    setup->hifi_response_timer->setInterval(HIFI_INITIAL_UPDATE_INTERVAL_MSEC); // 250ms, Qt::CoarseTimer acceptable
 
     qDebug() << "HifiConnection::Connect() - New client" << s << ice_client_id << s->peerAddress() << s->peerPort();
     client_socket = s;
@@ -75,6 +72,8 @@ HifiConnection::HifiConnection(QWebSocket * s)
 
     started_hifi_connect = false;
     hifi_socket = new QUdpSocket(this);
+    // Bind up front so routed sends can use the native descriptor before Qt would auto-bind it
+    hifi_socket->bind(QHostAddress::AnyIPv4, 0);
     connect(hifi_socket, SIGNAL(readyRead()), this, SLOT(ParseHifiResponse()));
 
     QJsonObject connected_object;
@@ -90,6 +89,9 @@ HifiConnection::HifiConnection(QWebSocket * s)
     connect(timeout_timer, &QTimer::timeout, this, &HifiConnection::Timeout);
     timeout_timer->setInterval(HIFI_TIMEOUT_MSEC/4);
     timeout_timer->start();
+
+    // STUN needs nothing from the client, so it runs while the browser negotiates and the place is looked up
+    StartStun();
 }
 
 HifiConnection::~HifiConnection()
@@ -97,25 +99,45 @@ HifiConnection::~HifiConnection()
 
 }
 
-void HifiConnection::HandleLookupResult(const QHostInfo& hostInfo, QString addr_type)
+size_t ConnectionSetup::GetMemoryFootprint() const
 {
-    if (hostInfo.error() != QHostInfo::NoError) {
-        qDebug() << "Task::handleLookupResult() - Lookup failed for" << hostInfo.lookupId() << ":" << hostInfo.errorString();
-    } else {
-        for (int i = 0; i < hostInfo.addresses().size(); i++) {
-            // just take the first IPv4 address
-            QHostAddress address = hostInfo.addresses()[i];
-            if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+    size_t bytes = sizeof(ConnectionSetup) + 3 * sizeof(QTimer);
+    const QString * strings[] = {&username, &password, &domain_name, &stun_server_hostname, &ice_server_hostname, &token, &refreshToken, &tokenType};
+    for (const QString * string : strings) {
+        bytes += string->capacity() * sizeof(QChar);
+    }
+    bytes += username_signature.capacity() + stun_response.capacity();
+    bytes += keypair.public_key.capacity() + keypair.private_key.capacity();
+    return bytes;
+}
 
-                if (addr_type == "stun") stun_server_address = address;
-                else if (addr_type == "ice") ice_server_address = address;
+ConnectionFootprint HifiConnection::GetMemoryFootprint()
+{
+    ConnectionFootprint footprint;
+    footprint.connection = sizeof(HifiConnection) + domain_place_name.capacity() * sizeof(QChar);
+    footprint.setup = setup ? setup->GetMemoryFootprint() : 0;
+    footprint.nodes = 0;
+    for (Node * node : nodes) {
+        footprint.nodes += node->GetMemoryFootprint();
+    }
+    footprint.send_batch = server_send_batch.GetAllocatedBytes();
+    return footprint;
+}
 
-                qDebug() << "Task::handleLookupResult() - QHostInfo lookup result for"
-                    << hostInfo.hostName() << "with lookup ID" << hostInfo.lookupId() << "is" << address.toString();
-                break;
-            }
-        }
+void HifiConnection::ReleaseSetup()
+{
+    if (!setup) {
+        return;
     }
+
+    // Stopped first so none of them fires between now and the deferred delete
+    QTimer * timers[] = {setup->stun_response_timer, setup->ice_response_timer, setup->hifi_response_timer};
+    for (QTimer * timer : timers) {
+        timer->stop();
+        timer->deleteLater();
+    }
+
+    setup.reset();
 }
 
 void HifiConnection::UpdateLocalSocket()
@@ -146,6 +168,7 @@ void HifiConnection::ConnectedForLocalSocketTest()
             //qDebug() << "HifiConnection::connectedForLocalSocketTest() - Local address: " << local_address;
 
             has_tcp_checked_local_socket = true;
+            AdvanceBringUp();
         }
 
         local_ip_test_socket->deleteLater();
@@ -166,6 +189,7 @@ void HifiConnection::ErrorTestingLocalSocket()
             //qDebug() << "HifiConnection::errorTestingLocalSocket() - Local address: " << local_address;
 
             has_tcp_checked_local_socket = true;
+            AdvanceBringUp();
         }
 
         local_ip_test_socket->deleteLater();
@@ -209,30 +233,9 @@ QHostAddress HifiConnection::GetGuessedLocalAddress()
 
 void HifiConnection::Stop()
 {
-    if (asset_server) {
-        delete asset_server;
-        asset_server = nullptr;
-    }
-    if (audio_mixer) {
-        delete audio_mixer;
-        audio_mixer = nullptr;
-    }
-    if (messages_mixer) {
-        delete messages_mixer;
-        messages_mixer = nullptr;
-    }
-    if (avatar_mixer) {
-        delete avatar_mixer;
-        avatar_mixer = nullptr;
-    }
-    if (entity_script_server) {
-        delete entity_script_server;
-        entity_script_server = nullptr;
-    }
-    if (entity_server) {
-        delete entity_server;
-        entity_server = nullptr;
-    }
+    routing_table.Clear();
+    qDeleteAll(nodes);
+    nodes.clear();
 
     if (data_channel) {
         ClearDataChannel();
@@ -243,72 +246,60 @@ void HifiConnection::Stop()
         timeout_timer = nullptr;
     }
 
-    if (ice_response_timer) {
-        delete ice_response_timer;
-        ice_response_timer = nullptr;
-    }
-
-    if (stun_response_timer) {
-        delete stun_response_timer;
-        stun_response_timer = nullptr;
-    }
-
-    if (hifi_response_timer) {
-        delete hifi_response_timer;
-        hifi_response_timer = nullptr;
-    }
+    ReleaseSetup();
 
     if (client_socket) {
         delete client_socket;
         client_socket = nullptr;
     }
 
+    if (client_framing_enabled) {
+        const quint64 num_framed_messages = client_message_writer.GetNumMessages();
+        qDebug() << "HifiConnection::Stop() - Framed client messages:" << num_framed_messages << "Frames:" << client_message_writer.GetNumFrames()
+                 << "Average frames per message:" << ((num_framed_messages > 0) ? (double) client_message_writer.GetNumFrames() / num_framed_messages : 0.0);
+    }
+
     if (hifi_socket) {
+        FlushServerMessages();
+
+        const quint64 num_flushes = server_send_batch.GetNumFlushes();
+        qDebug() << "HifiConnection::Stop() - Server send batches:" << num_flushes << "Datagrams:" << server_send_batch.GetNumDatagrams()
+                 << "Average batch:" << ((num_flushes > 0) ? (double) server_send_batch.GetNumDatagrams() / num_flushes : 0.0)
+                 << "Largest batch:" << server_send_batch.GetMaxBatchSize() << "Dropped:" << server_send_batch.GetNumDropped();
+
         delete hifi_socket;
         hifi_socket = nullptr;
     }
 }
 
-void HifiConnection::DomainRequestFinished()
+void HifiConnection::PlaceLookupFinished(const PlaceInfo& place)
 {
-    QNetworkReply *domain_reply = qobject_cast<QNetworkReply *>(sender());
-    if (domain_reply) {
-        QByteArray domain_reply_contents;
-        if (domain_reply->error() == QNetworkReply::NoError && domain_reply->isOpen()) {
-            domain_reply_contents += domain_reply->readAll();
-
-            //qDebug() << domain_reply_contents;
-
-            QJsonDocument doc;
-            doc = QJsonDocument::fromJson(domain_reply_contents);
-            QJsonObject obj = doc.object();
-            QJsonObject data = obj["data"].toObject();
-            QJsonObject place = data["place"].toObject();
-            QJsonObject domain = place["domain"].toObject();
-            domain_id = QUuid(domain["id"].toString());
-            domain_place_name = domain["default_place_name"].toString();
-
-            if (domain.contains("ice_server_address")) {
-                ice_server_address = QHostAddress(domain["ice_server_address"].toString());
-            }
+    if (place.valid) {
+        domain_id = place.domain_id;
+        domain_place_name = place.default_place_name;
+
+        if (!place.ice_server_address.isEmpty()) {
+            ice_server_address = QHostAddress(place.ice_server_address);
         }
-        domain_reply->close();
-        domain_reply->deleteLater();
     }
 
-    qDebug() << "HifiConnection::domainRequestFinished() - Domain name" << domain_name;
-    qDebug() << "HifiConnection::domainRequestFinished() - Domain place name" << domain_place_name;
-    qDebug() << "HifiConnection::domainRequestFinished() - Domain ID" << domain_id;
+    if (setup) qDebug() << "HifiConnection::PlaceLookupFinished() - Domain name" << setup->domain_name;
+    qDebug() << "HifiConnection::PlaceLookupFinished() - Domain place name" << domain_place_name;
+    qDebug() << "HifiConnection::PlaceLookupFinished() - Domain ID" << domain_id;
 
     finished_domain_id_request = true;
-    if (data_channel && finished_domain_id_request && !started_hifi_connect) {
-        started_hifi_connect = true;
-        Q_EMIT WebRTCConnectionReady();
-    }
+    LogBringUp("Place lookup");
+    AdvanceBringUp();
 }
 
 void HifiConnection::RequestAccessTokenFinished() {
     QNetworkReply* reply = reinterpret_cast<QNetworkReply*>(sender());
+    // Replies belong to the shared MetaverseClient, so they have to be freed here
+    reply->deleteLater();
+    if (!setup) {
+        // Connected, or stopped, before the token arrived
+        return;
+    }
 
     QJsonDocument response = QJsonDocument::fromJson(reply->readAll());
     const QJsonObject& root_object = response.object();
@@ -326,10 +317,10 @@ void HifiConnection::RequestAccessTokenFinished() {
 
             qDebug() << "Storing an account with access-token for" << url.toString();
 
-            token = root_object["access_token"].toString();
-            refreshToken = root_object["refresh_token"].toString();
-            expiryTimestamp = QDateTime::currentMSecsSinceEpoch() + (root_object["expires_in"].toDouble() * 1000);
-            tokenType = root_object["token_type"].toString();
+            setup->token = root_object["access_token"].toString();
+            setup->refreshToken = root_object["refresh_token"].toString();
+            setup->expiryTimestamp = QDateTime::currentMSecsSinceEpoch() + (root_object["expires_in"].toDouble() * 1000);
+            setup->tokenType = root_object["token_type"].toString();
         }
     } else {
         qDebug() <<  "Error in response for password grant -" << root_object["error_description"].toString();
@@ -340,7 +331,34 @@ void HifiConnection::RequestAccessTokenError(QNetworkReply::NetworkError error)
     qDebug() << "HifiConnection: failed to fetch access token - " << error;
 }
 
-void HifiConnection::StartStun()
+void HifiConnection::AdvanceBringUp()
+{
+    if (!setup) {
+        return;
+    }
+
+    // The browser's side is ready once its data channel is registered and we know which domain it wants
+    if (!started_hifi_connect && data_channel && finished_domain_id_request) {
+        qDebug() << "HifiConnection::AdvanceBringUp() - Data channels registered";
+        started_hifi_connect = true;
+        LogBringUp("Data channel");
+        SetupDataChannel();
+    }
+
+    // The ICE query carries our public (STUN) and local addresses and the domain ID, and may go to an ICE server
+    // named by the place
+    if (!setup->started_ice && setup->stun_finished && has_tcp_checked_local_socket && finished_domain_id_request) {
+        setup->started_ice = true;
+        StartIce();
+    }
+
+    // Whatever the domain sends back goes to the client, so it needs the data channel as well
+    if (!started_domain_connect && setup->ice_finished && started_hifi_connect) {
+        StartDomainConnect();
+    }
+}
+
+void HifiConnection::SetupDataChannel()
 {
     // Register Domain Server DC callbacks here
     std::function<void(std::string)> onErrorCallback = [this](std::string message) {
@@ -351,62 +369,22 @@ void HifiConnection::StartStun()
     std::function<void(rtcdcpp::ChunkPtr)> onBinaryMessageCallback = [this](rtcdcpp::ChunkPtr message) {
         this->client_timestamp = Utils::GetTimestamp();
 
-        NodeType_t server = (NodeType_t) message->Data()[0];
-        QByteArray packet = QByteArray((char *) (message->Data() + sizeof(NodeType_t)), message->Length() - 1);
-        //qDebug() << "HifiConnection::onMessage() - " << (char) server << packet << packet.size();
-
-        if (server == NodeType::DomainServer) {
-            //qDebug() << "domain";
-            bool is_control_packet = *reinterpret_cast<uint32_t*>(packet.data()) & CONTROL_BIT_MASK;
-            if (is_control_packet) {
-                this->SendServerMessage(packet, domain_public_address, domain_public_port);
+        const char * message_data = reinterpret_cast<const char *>(message->Data());
+        const int message_size = (int) message->Length();
+
+        if (MessageFraming::IsFramedMessage(message_data, message_size)) {
+            // Several datagrams packed by the client, forward each one straight out of the chunk buffer
+            FramedMessageReader reader(message_data, message_size);
+            NodeType_t server;
+            const char * packet;
+            int packet_size;
+            while (reader.Next(server, packet, packet_size)) {
+                ProcessClientPacket(server, packet, packet_size);
             }
-            else {
-                std::unique_ptr<Packet> response_packet = Packet::FromReceivedPacket(packet.data(), (qint64) packet.size());// check if this was a control packet or a data packet
-                if (response_packet->GetType() == PacketType::ProxiedICEPing) {
-                    uint8_t ping_type = 2; //Default to public
-                    response_packet->read(reinterpret_cast<char*>(&ping_type), sizeof(uint8_t));
-                    //qDebug() << "proxiediceping" << ping_type;
-                    SendIcePing(response_packet->GetSequenceNumber(), ping_type);
-                }
-                else if (response_packet->GetType() == PacketType::ProxiedICEPingReply) {
-                    uint8_t ping_type = 2; //Default to public
-                    response_packet->read(reinterpret_cast<char*>(&ping_type), sizeof(uint8_t));
-                    //qDebug() << "proxiedicepingreply" << ping_type;
-                    SendIcePingReply(response_packet->GetSequenceNumber(), ping_type);
-                }
-                else if (response_packet->GetType() == PacketType::ProxiedDomainListRequest) {
-                    //qDebug() << "proxieddomainlistrequest";
-                    SendDomainCheckInRequest(response_packet->GetSequenceNumber());
-                }
-                else {
-                    this->SendServerMessage(packet, domain_public_address, domain_public_port);
-                }
-            }
-        }
-        else if (server == NodeType::AssetServer) {
-            //qDebug() << "asset";
-            if (this->asset_server) SendServerMessage(packet, asset_server->GetPublicAddress(), asset_server->GetPublicPort());
         }
-        else if (server == NodeType::AudioMixer) {
-            //qDebug() << "audio";
-            if (this->audio_mixer) SendServerMessage(packet, audio_mixer->GetPublicAddress(), audio_mixer->GetPublicPort());
-        }
-        else if (server == NodeType::AvatarMixer) {
-            //qDebug() << "avatar";
-            if (this->avatar_mixer) SendServerMessage(packet, avatar_mixer->GetPublicAddress(), avatar_mixer->GetPublicPort());
-        }
-        else if (server == NodeType::MessagesMixer) {
-            //qDebug() << "messages";
-            if (this->messages_mixer) SendServerMessage(packet, messages_mixer->GetPublicAddress(), messages_mixer->GetPublicPort());
-        }
-        else if (server == NodeType::EntityServer) {
-            //qDebug() << "entity";
-            if (this->entity_server) SendServerMessage(packet, entity_server->GetPublicAddress(), entity_server->GetPublicPort());
-        }
-        else if (server == NodeType::EntityScriptServer) {
-            //qDebug() << "entityscript";
-            if (this->entity_script_server) SendServerMessage(packet, entity_script_server->GetPublicAddress(), entity_script_server->GetPublicPort());
+        else if (message_size > (int) sizeof(NodeType_t)) {
+            // Forward straight out of the chunk buffer, skipping the leading node type byte
+            ProcessClientPacket((NodeType_t) message_data[0], message_data + sizeof(NodeType_t), message_size - (int) sizeof(NodeType_t));
         }
     };
     data_channel->SetOnBinaryMsgCallback(onBinaryMessageCallback);
@@ -418,14 +396,114 @@ void HifiConnection::StartStun()
     };
     data_channel->SetOnClosedCallback(onClosed);
 
+    // STUN usually finishes before the browser does
+    if (!setup->stun_response.isEmpty()) {
+        SendClientMessageFromNode(NodeType::DomainServer, setup->stun_response.constData(), setup->stun_response.size());
+        setup->stun_response.clear();
+        // With framing on it would otherwise wait for the next server readyRead
+        FlushClientMessages();
+    }
+}
+
+void HifiConnection::StartStun()
+{
     num_requests = 0;
     has_completed_current_request = false;
 
-    stun_response_timer->start();
+    const QHostAddress static_public_address = Utils::GetStaticPublicAddress();
+    if (setup && !static_public_address.isNull()) {
+        // No NAT in front of us, so the servers see exactly the address and port we are bound to
+        public_address = static_public_address;
+        public_port = hifi_socket->localPort();
+        local_port = public_port;
+        if (!has_tcp_checked_local_socket) {
+            local_address = static_public_address;
+            has_tcp_checked_local_socket = true;
+        }
+
+        qDebug() << "HifiConnection::StartStun() - Static public address" << public_address << "port" << public_port << ", skipping STUN";
+
+        // The client still learns its public address from a STUN response on the domain server channel
+        const QByteArray stun_response = Utils::CreateStunResponse(public_address, public_port);
+        FinishStun(stun_response.constData(), stun_response.size());
+        return;
+    }
+
+    // First request now rather than on the first timer tick
+    if (setup) setup->stun_response_timer->start();
+    SendStunRequest();
+}
+
+void HifiConnection::FinishStun(const char * response, int size)
+{
+    has_completed_current_request = true;
+    setup->stun_response_timer->stop();
+    setup->stun_finished = true;
+    LogBringUp("STUN");
+
+    if (started_hifi_connect) {
+        // Not always called from ParseHifiResponse, so flush here instead of relying on its readyRead
+        SendClientMessageFromNode(NodeType::DomainServer, response, size);
+        FlushClientMessages();
+    }
+    else {
+        setup->stun_response = QByteArray(response, size);
+    }
+
+    Q_EMIT StunFinished();
+}
+
+void HifiConnection::LogBringUp(const char * stage)
+{
+    if (setup) qDebug() << "HifiConnection::LogBringUp() -" << stage << "done after" << setup->bring_up_timer.elapsed() << "ms";
+}
+
+void HifiConnection::ProcessClientPacket(NodeType_t server, const char * packet, int packet_size)
+{
+    if (packet_size <= 0) {
+        return;
+    }
+
+    //qDebug() << "HifiConnection::ProcessClientPacket() - " << (char) server << packet_size;
+
+    if (server == NodeType::DomainServer) {
+        //qDebug() << "domain";
+        // Only the proxied requests are handled here, so peek at the header instead of building a Packet
+        PacketView view(packet, packet_size);
+        const PacketType type = (view.IsValid() && !view.IsControl()) ? view.GetType() : PacketType::Unknown;
+        if (type == PacketType::ProxiedICEPing) {
+            uint8_t ping_type = 2; //Default to public
+            view.ReadPayload(0, &ping_type, sizeof(uint8_t));
+            //qDebug() << "proxiediceping" << ping_type;
+            QMetaObject::invokeMethod(this, "SendIcePing", Qt::QueuedConnection, Q_ARG(quint32, view.GetSequenceNumber()), Q_ARG(quint8, ping_type));
+        }
+        else if (type == PacketType::ProxiedICEPingReply) {
+            uint8_t ping_type = 2; //Default to public
+            view.ReadPayload(0, &ping_type, sizeof(uint8_t));
+            //qDebug() << "proxiedicepingreply" << ping_type;
+            QMetaObject::invokeMethod(this, "SendIcePingReply", Qt::QueuedConnection, Q_ARG(quint32, view.GetSequenceNumber()), Q_ARG(quint8, ping_type));
+        }
+        else if (type == PacketType::ProxiedDomainListRequest) {
+            //qDebug() << "proxieddomainlistrequest";
+            // The setup state it reads is released on the connection thread once the domain accepts us
+            QMetaObject::invokeMethod(this, "SendDomainCheckInRequest", Qt::QueuedConnection, Q_ARG(quint32, view.GetSequenceNumber()));
+        }
+        else {
+            NodeRoute route;
+            if (routing_table.GetRoute(NodeType::DomainServer, route)) SendServerMessage(packet, packet_size, route);
+        }
+    }
+    else {
+        NodeRoute route;
+        if (routing_table.GetRoute(server, route)) SendServerMessage(packet, packet_size, route);
+    }
 }
 
 void HifiConnection::Timeout()
 {
+    // Give back send arena left over from the last burst
+    server_send_batch.Trim();
+
     quint64 timestamp = Utils::GetTimestamp();
     //qDebug() << "Timeout" << timestamp / 1000 << client_timestamp / 1000 << server_timestamp / 1000;
 
@@ -458,132 +536,127 @@ void HifiConnection::StartIce()
     num_requests = 0;
     has_completed_current_request = false;
 
-    ice_response_timer->start();
+    if (setup) setup->ice_response_timer->start();
+    SendIceRequest();
 }
 
 void HifiConnection::StartDomainConnect()
 {
     connect(hifi_socket, SIGNAL(disconnected()), this, SLOT(ServerDisconnected()));
 
+    started_domain_connect = true;
     num_requests = 0;
     has_completed_current_request = false;
 
-    hifi_response_timer->start();
+    if (setup) setup->hifi_response_timer->start();
+    SendDomainCheckIn();
 }
 
 void HifiConnection::ParseHifiResponse()
 {
-    while (hifi_socket->hasPendingDatagrams()) {
-        QByteArray datagram;
-        datagram.resize(hifi_socket->pendingDatagramSize());
-        QHostAddress sender;
-        quint16 sender_port;
-
-        hifi_socket->readDatagram(datagram.data(), datagram.size(), &sender, &sender_port);
-
-        server_timestamp = Utils::GetTimestamp();
-
-        //Stun Server response;
-        if (sender.toIPv4Address() == stun_server_address.toIPv4Address() && sender_port == stun_server_port) {
-            //qDebug() << "HifiConnection::ParseHifiResponse() - read packet from " << sender << ":" << sender_port << " of size " << datagram.size() << " bytes";
-
-            // check the cookie to make sure this is actually a STUN response
-            // and read the first attribute and make sure it is a XOR_MAPPED_ADDRESS
-            const int NUM_BYTES_MESSAGE_TYPE_AND_LENGTH = 4;
-            const uint16_t XOR_MAPPED_ADDRESS_TYPE = htons(0x0020);
-
-            const uint32_t RFC_5389_MAGIC_COOKIE_NETWORK_ORDER = htonl(RFC_5389_MAGIC_COOKIE);
-
-            int attribute_start_index = NUM_BYTES_STUN_HEADER;
-            if (memcmp(datagram.data() + NUM_BYTES_MESSAGE_TYPE_AND_LENGTH,
-                       &RFC_5389_MAGIC_COOKIE_NETWORK_ORDER,
-                       sizeof(RFC_5389_MAGIC_COOKIE_NETWORK_ORDER)) != 0) {
-                qDebug() << "HifiConnection::ParseHifiResponse() - STUN response cannot be parsed, magic cookie is invalid";
-                Q_EMIT Disconnected();
+    DatagramReceiveBatch& batch = DatagramReceiveBatch::ForCurrentThread();
+    QHostAddress sender_address;
+    quint16 sender_port = 0;
+
+#ifdef Q_OS_LINUX
+    // Drain the socket a batch at a time, one recvmmsg per DatagramReceiveBatch::MAX_DATAGRAMS datagrams
+    int num_received = 0;
+    do {
+        num_received = batch.Receive(hifi_socket->socketDescriptor());
+        for (int i = 0; i < num_received; i++) {
+            if (batch.IsTruncated(i)) {
+                qDebug() << "HifiConnection::ParseHifiResponse() - Dropping oversized datagram";
+                continue;
+            }
+            if (!ProcessServerDatagram(batch.GetData(i), batch.GetSize(i), batch.GetSenderIPv4(i), batch.GetSenderPort(i))) {
                 return;
             }
+        }
+    } while (num_received == DatagramReceiveBatch::MAX_DATAGRAMS);
 
-            // enumerate the attributes to find XOR_MAPPED_ADDRESS_TYPE
-            while (attribute_start_index < datagram.size()) {
-                if (memcmp(datagram.data() + attribute_start_index, &XOR_MAPPED_ADDRESS_TYPE, sizeof(XOR_MAPPED_ADDRESS_TYPE)) == 0) {
-                    const int NUM_BYTES_STUN_ATTR_TYPE_AND_LENGTH = 4;
-                    const int NUM_BYTES_FAMILY_ALIGN = 1;
-                    const uint8_t IPV4_FAMILY_NETWORK_ORDER = htons(0x01) >> 8;
-
-                    int byte_index = attribute_start_index + NUM_BYTES_STUN_ATTR_TYPE_AND_LENGTH + NUM_BYTES_FAMILY_ALIGN;
-
-                    uint8_t address_family = 0;
-                    memcpy(&address_family, datagram.data() + byte_index, sizeof(address_family));
-
-                    byte_index += sizeof(address_family);
-
-                    if (address_family == IPV4_FAMILY_NETWORK_ORDER) {
-                        // grab the X-Port
-                        uint16_t xor_mapped_port = 0;
-                        memcpy(&xor_mapped_port, datagram.data() + byte_index, sizeof(xor_mapped_port));
-
-                        public_port = ntohs(xor_mapped_port) ^ (ntohl(RFC_5389_MAGIC_COOKIE_NETWORK_ORDER) >> 16);
+    // QUdpSocket keeps its read notifier disabled after readyRead until readDatagram is called,
+    // so finish with one read through Qt to re-arm it. This normally finds the socket empty.
+    qint64 datagram_size = hifi_socket->readDatagram(batch.GetData(0), DatagramReceiveBatch::MAX_DATAGRAM_SIZE, &sender_address, &sender_port);
+    if (datagram_size >= 0) {
+        ProcessServerDatagram(batch.GetData(0), (int) datagram_size, sender_address.toIPv4Address(), sender_port);
+    }
+#else
+    while (hifi_socket->hasPendingDatagrams()) {
+        qint64 datagram_size = hifi_socket->readDatagram(batch.GetData(0), DatagramReceiveBatch::MAX_DATAGRAM_SIZE, &sender_address, &sender_port);
+        if (datagram_size < 0) {
+            break;
+        }
+        if (!ProcessServerDatagram(batch.GetData(0), (int) datagram_size, sender_address.toIPv4Address(), sender_port)) {
+            return;
+        }
+    }
+#endif
 
-                        byte_index += sizeof(xor_mapped_port);
+    // Whatever was coalesced while draining goes out now, so framing never holds a packet past this readyRead
+    FlushClientMessages();
+}
 
-                        // grab the X-Address
-                        uint32_t xor_mapped_address = 0;
-                        memcpy(&xor_mapped_address, datagram.data() + byte_index, sizeof(xor_mapped_address));
+bool HifiConnection::ProcessServerDatagram(const char * data, int size, quint32 sender_ipv4, quint16 sender_port)
+{
+    server_timestamp = Utils::GetTimestamp();
 
-                        uint32_t stun_address = ntohl(xor_mapped_address) ^ ntohl(RFC_5389_MAGIC_COOKIE_NETWORK_ORDER);
+    //Stun Server response, only expected while setting up
+    if (setup && sender_ipv4 == stun_server_address.toIPv4Address() && sender_port == stun_server_port) {
+        //qDebug() << "HifiConnection::ParseHifiResponse() - read packet from " << QHostAddress(sender_ipv4) << ":" << sender_port << " of size " << size << " bytes";
 
-                        // QHostAddress newPublicAddress(stun_address);
-                        public_address = QHostAddress(stun_address);
+        // check the cookie to make sure this is actually a STUN response
+        // and read the first attribute and make sure it is a XOR_MAPPED_ADDRESS
+        if (!Utils::HasStunMagicCookie(data, size)) {
+            qDebug() << "HifiConnection::ParseHifiResponse() - STUN response cannot be parsed, magic cookie is invalid";
+            Q_EMIT Disconnected();
+            return false;
+        }
 
-                        qDebug() << "HifiConnection::ParseHifiResponse() - Public address: " << public_address;
-                        qDebug() << "HifiConnection::ParseHifiResponse() - Public port: " << public_port;
+        // Answers to our retries can trail in after the first one, by then the shared request state belongs to ICE
+        if (!setup->stun_finished && Utils::ParseStunResponse(data, size, public_address, public_port)) {
+            qDebug() << "HifiConnection::ParseHifiResponse() - Public address: " << public_address;
+            qDebug() << "HifiConnection::ParseHifiResponse() - Public port: " << public_port;
 
-                        local_port = hifi_socket->localPort();
+            local_port = hifi_socket->localPort();
 
-                        qDebug() << "HifiConnection::ParseHifiResponse() - Local address: " << local_address;
-                        qDebug() << "HifiConnection::ParseHifiResponse() - Local port: " << local_port;
+            qDebug() << "HifiConnection::ParseHifiResponse() - Local address: " << local_address;
+            qDebug() << "HifiConnection::ParseHifiResponse() - Local port: " << local_port;
 
-                        has_completed_current_request = true;
-                        stun_response_timer->stop();
+            FinishStun(data, size);
+        }
+        return true;
+    }
 
-                        SendClientMessageFromNode(NodeType::DomainServer, datagram);
-                        Q_EMIT StunFinished();
-                        break;
-                    }
-                }
-                else {
-                    // push forward attribute_start_index by the length of this attribute
-                    const int NUM_BYTES_ATTRIBUTE_TYPE = 2;
+    PacketView view(data, size);
+    if (view.IsValid() && !view.IsControl()) {
+        ParseDatagram(view);
+    }
 
-                    uint16_t attribute_length = 0;
-                    memcpy(&attribute_length, datagram.data() + attribute_start_index + NUM_BYTES_ATTRIBUTE_TYPE,
-                           sizeof(attribute_length));
-                    attribute_length = ntohs(attribute_length);
+    // Anything we have no route for came from the domain server
+    SendClientMessageFromNode(routing_table.GetNodeTypeFromAddress(sender_ipv4, sender_port, NodeType::DomainServer), data, size);
 
-                    attribute_start_index += NUM_BYTES_MESSAGE_TYPE_AND_LENGTH + attribute_length;
-                }
-            }
-            continue;
-        }
+    return true;
+}
 
-        bool is_control_packet = *reinterpret_cast<uint32_t*>(datagram.data()) & CONTROL_BIT_MASK;
-        if (!is_control_packet) {
-            ParseDatagram(datagram);
-        }
+void HifiConnection::ParseDatagram(const PacketView& view)
+{
+    switch (view.GetType()) {
+    case PacketType::ICEServerPeerInformation:
+    case PacketType::DomainServerConnectionToken:
+    case PacketType::DomainList:
+    case PacketType::DomainConnectionDenied:
+        break;
+    default:
+        // Everything else is only forwarded to the client
+        return;
+    }
 
-        Node * node = GetNodeFromAddress(sender, sender_port);
-        if (node) {
-            SendClientMessageFromNode(node->GetNodeType(), datagram);
-        }
-        else {
-            SendClientMessageFromNode(NodeType::DomainServer, datagram);
-        }
+    if (!setup) {
+        // All of these only matter until the domain has accepted us
+        return;
     }
-}
 
-void HifiConnection::ParseDatagram(QByteArray datagram)
-{
-    std::unique_ptr<Packet> response_packet = Packet::FromReceivedPacket(datagram.data(), (qint64) datagram.size());// check if this was a control packet or a data packet
+    std::unique_ptr<Packet> response_packet = Packet::FromReceivedPacket(view.GetData(), (qint64) view.GetSize());
     //qDebug() << "HifiConnection::ParseHifiResponse() - Packet type" << (int) response_packet->GetType();
     //ICE response
     if (response_packet->GetType() == PacketType::ICEServerPeerInformation)
@@ -594,16 +667,20 @@ void HifiConnection::ParseDatagram(QByteArray datagram)
 
         if (domain_uuid != domain_id){
             qDebug() << "HifiConnection::ParseHifiResponse() - Error: Domain ID's do not match " << domain_uuid << domain_id;
-            ice_response_timer->stop();
+            setup->ice_response_timer->stop();
             Q_EMIT Disconnected();
         }
 
         qDebug() << "HifiConnection::ParseHifiResponse() - Domain ID: " << domain_uuid << "Domain Public Address: " << domain_public_address << "Domain Public Port: " << domain_public_port << "Domain Local Address: " << domain_local_address << "Domain Local Port: " << domain_local_port;
 
+        routing_table.SetRoute(NodeType::DomainServer, domain_public_address.toIPv4Address(), domain_public_port);
+
         has_completed_current_request = true;
-        if (!started_domain_connect)
+        if (!setup->ice_finished)
         {
-            ice_response_timer->stop();
+            setup->ice_response_timer->stop();
+            setup->ice_finished = true;
+            LogBringUp("ICE");
             Q_EMIT IceFinished();
         }
     }
@@ -611,9 +688,9 @@ void HifiConnection::ParseDatagram(QByteArray datagram)
         num_requests = 0; // Reset number of requests so we can keep sending DomainConnectRequests
 
         QByteArray token(response_packet->readAll().constData(), NUM_BYTES_RFC4122_UUID);
-        domain_connection_token = QUuid::fromRfc4122(token);
+        setup->domain_connection_token = QUuid::fromRfc4122(token);
 
-        qDebug() << "HifiConnection::ParseHifiResponse() - Domain connection token: " << domain_connection_token;
+        qDebug() << "HifiConnection::ParseHifiResponse() - Domain connection token: " << setup->domain_connection_token;
     }
     else if (response_packet->GetType() == PacketType::DomainList && !domain_connected) {
         qDebug() << "HifiConnection::ParseHifiResponse() - Process domain list";
@@ -638,7 +715,7 @@ void HifiConnection::ParseDatagram(QByteArray datagram)
         packet_stream >> local_id;
 
         // if this was the first domain-server list from this domain, we've now connected
-        hifi_response_timer->stop();
+        setup->hifi_response_timer->stop();
         domain_connected = true;
 
         // pull the permissions/right/privileges for this node out of the stream
@@ -658,6 +735,12 @@ void HifiConnection::ParseDatagram(QByteArray datagram)
         while (packet_stream.device()->pos() < response_packet->GetDataSize() - response_packet->TotalHeaderSize()) {
             ParseNodeFromPacketStream(packet_stream);
         }
+
+        // Time to first packet: from the client connecting to the domain accepting us
+        LogBringUp("Domain connect");
+
+        // Nothing from the setup is needed once connected
+        ReleaseSetup();
     }
     else if (response_packet->GetType() == PacketType::DomainConnectionDenied) {
         uint8_t reasonCode;
@@ -675,7 +758,7 @@ void HifiConnection::ParseDatagram(QByteArray datagram)
         qDebug() << "HifiConnection::ParseHifiResponse() - DomainConnectionDenied - Code: " << reasonCode;  //"Reason: "<< reason;
 
         if (reasonCode == 2) {
-            username = "";
+            setup->username = "";
         }
     }
 }
@@ -714,60 +797,48 @@ void HifiConnection::ParseNodeFromPacketStream(QDataStream& packet_stream)
     node->SetConnectionSecret(connection_secret_uuid);
     node->SetPermissions((Permissions) node_permissions);
 
-    switch (node_type) {
-        case NodeType::AssetServer : {
-            qDebug() << "HifiConnection::ParseNodeFromPacketStream() - Registering asset server" << node_public_address << node_public_port;
-            asset_server = node;
-            break;
-        }
-        case NodeType::AudioMixer : {
-            qDebug() << "HifiConnection::ParseNodeFromPacketStream() - Registering audio mixer" << node_public_address << node_public_port;
-            audio_mixer = node;
-            break;
-        }
-        case NodeType::AvatarMixer : {
-            qDebug() << "HifiConnection::ParseNodeFromPacketStream() - Registering avatar mixer" << node_public_address << node_public_port;
-            avatar_mixer = node;
-            break;
-        }
-        case NodeType::MessagesMixer : {
-            qDebug() << "HifiConnection::ParseNodeFromPacketStream() - Registering messages mixer" << node_public_address << node_public_port;
-            messages_mixer = node;
-            break;
-        }
-        case NodeType::EntityServer : {
-            qDebug() << "HifiConnection::ParseNodeFromPacketStream() - Registering entity server" << node_public_address << node_public_port;
-            entity_server = node;
-            break;
-        }
-        case NodeType::EntityScriptServer : {
-            qDebug() << "HifiConnection::ParseNodeFromPacketStream() - Registering entity script server" << node_public_address << node_public_port;
-            entity_script_server = node;
-            break;
-        }
-        default: {
-            break;
-        }
+    if (!node_types_of_interest.contains(node_type)) {
+        delete node;
+        return;
+    }
+
+    qDebug() << "HifiConnection::ParseNodeFromPacketStream() - Registering node" << (char) node_type << node_public_address << node_public_port;
+
+    // A node re-announced by the domain replaces the one we already had
+    Node * previous_node = nodes.value(node_type, nullptr);
+    if (previous_node) {
+        delete previous_node;
     }
+    nodes.insert(node_type, node);
+    routing_table.SetRoute(node_type, node_public_address.toIPv4Address(), node_public_port);
 }
 
 void HifiConnection::SendStunRequest()
 {
-    if (!finished_domain_id_request || !has_tcp_checked_local_socket) {
+    if (!setup) {
         return;
     }
 
     if (num_requests == HIFI_NUM_INITIAL_REQUESTS_BEFORE_FAIL) {
-        qDebug() << "HifiConnection::SendStunRequest() - Stopping stun requests to" << stun_server_hostname << stun_server_port;
-        stun_response_timer->stop();
+        qDebug() << "HifiConnection::SendStunRequest() - Stopping stun requests to" << setup->stun_server_hostname << stun_server_port;
+        setup->stun_response_timer->stop();
         Q_EMIT Disconnected();
         //disconnect(stun_response_timer, &QTimer::timeout, this, &HifiConnection::SendStunRequest);
         //stun_response_timer->deleteLater();
         return;
     }
 
+    if (stun_server_address.isNull()) {
+        stun_server_address = HostResolverCache::Instance().GetAddress(setup->stun_server_hostname);
+        if (stun_server_address.isNull()) {
+            qDebug() << "HifiConnection::SendStunRequest() - Waiting for" << setup->stun_server_hostname << "to resolve";
+            ++num_requests;
+            return;
+        }
+    }
+
     if (!has_completed_current_request) {
-        qDebug() << "HifiConnection::SendStunRequest() - Sending initial stun request to" << stun_server_hostname << stun_server_port;
+        qDebug() << "HifiConnection::SendStunRequest() - Sending initial stun request to" << setup->stun_server_hostname << stun_server_port;
         ++num_requests;
     }
     else {
@@ -775,45 +846,37 @@ void HifiConnection::SendStunRequest()
         return;
     }
 
-    char * stun_request_packet = (char *) malloc(NUM_BYTES_STUN_HEADER);
-
-    int packet_index = 0;
-    const uint32_t RFC_5389_MAGIC_COOKIE_NETWORK_ORDER = htonl(RFC_5389_MAGIC_COOKIE);
-
-    // leading zeros + message type
-    const uint16_t REQUEST_MESSAGE_TYPE = htons(0x0001);
-    memcpy(stun_request_packet + packet_index, &REQUEST_MESSAGE_TYPE, sizeof(REQUEST_MESSAGE_TYPE));
-    packet_index += sizeof(REQUEST_MESSAGE_TYPE);
-
-    // message length (no additional attributes are included)
-    uint16_t message_length = 0;
-    memcpy(stun_request_packet + packet_index, &message_length, sizeof(message_length));
-    packet_index += sizeof(message_length);
-
-    memcpy(stun_request_packet + packet_index, &RFC_5389_MAGIC_COOKIE_NETWORK_ORDER, sizeof(RFC_5389_MAGIC_COOKIE_NETWORK_ORDER));
-    packet_index += sizeof(RFC_5389_MAGIC_COOKIE_NETWORK_ORDER);
-
-    // transaction ID (random 12-byte unsigned integer)
-    const uint NUM_TRANSACTION_ID_BYTES = 12;
-    QUuid randomUUID = QUuid::createUuid();
-    memcpy(stun_request_packet + packet_index, randomUUID.toRfc4122().data(), NUM_TRANSACTION_ID_BYTES);
+    const QByteArray stun_request_packet = Utils::CreateStunRequest();
 
     qDebug () << "HifiConnection::SendStunRequest() - STUN address:" << stun_server_address << "STUN port:" << stun_server_port;
-    SendServerMessage(stun_request_packet, NUM_BYTES_STUN_HEADER, stun_server_address, stun_server_port);
+    SendServerMessage(stun_request_packet.constData(), stun_request_packet.size(), stun_server_address, stun_server_port);
 }
 
 void HifiConnection::SendIceRequest()
 {
+    if (!setup) {
+        return;
+    }
+
     if (num_requests == HIFI_NUM_INITIAL_REQUESTS_BEFORE_FAIL) {
         qDebug() << "HifiConnection::SendIceRequest() - Stopping ice requests to" << ice_server_address << ice_server_port;
 
-        ice_response_timer->stop();
+        setup->ice_response_timer->stop();
         Q_EMIT Disconnected();
         //disconnect(ice_response_timer, &QTimer::timeout, this, &HifiConnection::SendIceRequest);
         //ice_response_timer->deleteLater();
         return;
     }
 
+    if (ice_server_address.isNull()) {
+        ice_server_address = HostResolverCache::Instance().GetAddress(setup->ice_server_hostname);
+        if (ice_server_address.isNull()) {
+            qDebug() << "HifiConnection::SendIceRequest() - Waiting for" << setup->ice_server_hostname << "to resolve";
+            ++num_requests;
+            return;
+        }
+    }
+
     if (!has_completed_current_request) {
         qDebug() << "HifiConnection::SendIceRequest() - Sending intial ice request to" << ice_server_address << ice_server_port;
 
@@ -840,14 +903,14 @@ void HifiConnection::SendIceRequest()
 
 void HifiConnection::SendDomainCheckIn()
 {
-    if (!finished_domain_id_request) {
+    if (!setup || !finished_domain_id_request) {
         return;
     }
 
     if (num_requests == HIFI_NUM_INITIAL_REQUESTS_BEFORE_FAIL) {
             qDebug() << "HifiConnection::SendDomainConnectRequest() - Stopping domain requests to" << domain_place_name;
 
-        hifi_response_timer->stop();
+        setup->hifi_response_timer->stop();
         Q_EMIT Disconnected();
         //hifi_response_timer->deleteLater();
         return;
@@ -871,6 +934,11 @@ void HifiConnection::SendDomainCheckIn()
 void HifiConnection::KeypairRequestFinished()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (reply && !setup) {
+        // Connected, or stopped, before the upload finished
+        reply->deleteLater();
+        return;
+    }
     if (reply) {
         // double check if the finished network reply had a session ID in the header and make
         // sure that our session ID matches that value if so
@@ -880,7 +948,7 @@ void HifiConnection::KeypairRequestFinished()
 
         if (reply->error() == QNetworkReply::NoError) {
             qDebug() << "Uploaded public key to Metaverse API. RSA keypair generation is completed.";
-            waiting_for_keypair = false;
+            setup->waiting_for_keypair = false;
 
             //qDebug(networking) << "Received JSON response from metaverse API that has no matching callback.";
             //qDebug(networking) << QJsonDocument::fromJson(networkReply->readAll());
@@ -888,8 +956,8 @@ void HifiConnection::KeypairRequestFinished()
             qWarning() << "Public key upload failed from AccountManager" << reply->errorString();
 
             // we aren't waiting for a response any longer
-            waiting_for_keypair = false;
-            username = ""; // Reset username so user can still log in
+            setup->waiting_for_keypair = false;
+            setup->username = ""; // Reset username so user can still log in
 
             //qDebug(networking) << "Received error response from metaverse API that has no matching callback.";
             //qDebug(networking) << "Error" << networkReply->error() << "-" << networkReply->errorString();
@@ -901,58 +969,111 @@ void HifiConnection::KeypairRequestFinished()
     }
 }
 
-void HifiConnection::SendDomainCheckInRequest(uint32_t s)
+void HifiConnection::KeypairReady(RSAKeypair new_keypair)
 {
-    if (!finished_domain_id_request) {
+    if (!setup) {
         return;
     }
+    setup->taking_keypair = false;
 
-    bool requires_username_signature = !domain_connected && !domain_connection_token.isNull();
-
-    //Generate keypair
-    if (requires_username_signature && keypair_generator->GetPrivateKey().isEmpty()) {
-        qDebug() << "HifiConnection::SendDomainCheckInRequest() - Generating keypair for username signature";
-        num_requests = 0;
-        username_signature = QByteArray();
-        keypair_generator->GenerateKeypair();
-
-        if (!waiting_for_keypair) {
-            waiting_for_keypair = true;
-
-            // upload the public key so data-web has an up-to-date key
-            // setup a multipart upload to send up the public key
-            QHttpMultiPart* request_multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
-
-            QHttpPart public_key_part;
-            public_key_part.setHeader(QNetworkRequest::ContentTypeHeader, QVariant("application/octet-stream"));
-            public_key_part.setHeader(QNetworkRequest::ContentDispositionHeader,
-                                QVariant("form-data; name=\"public_key\"; filename=\"public_key\""));
-            public_key_part.setBody(keypair_generator->GetPublicKey());
-            request_multipart->append(public_key_part);
-
-            const QByteArray HIGH_FIDELITY_USER_AGENT = "Mozilla/5.0 (HighFidelityInterface)";
-            const auto METAVERSE_SESSION_ID_HEADER = QString("HFM-SessionID").toLocal8Bit();
-            const QByteArray ACCESS_TOKEN_AUTHORIZATION_HEADER = "Authorization";
-
-            QNetworkAccessManager * nam = new QNetworkAccessManager(this);
-            QNetworkRequest request;
-            request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
-            request.setHeader(QNetworkRequest::UserAgentHeader, HIGH_FIDELITY_USER_AGENT);
-            request.setRawHeader(METAVERSE_SESSION_ID_HEADER, uuidStringWithoutCurlyBraces(session_id).toLocal8Bit());
-            if (token != "") {
-                request.setRawHeader(ACCESS_TOKEN_AUTHORIZATION_HEADER, QString("Bearer %1").arg(token).toUtf8());
-            }
-            request.setUrl(QUrl("https://metaverse.highfidelity.com/api/v1/user/public_key"));
+    if (new_keypair.IsNull()) {
+        qDebug() << "HifiConnection::KeypairReady() - Keypair generation failed, will retry on next domain-server check in";
+        return;
+    }
+    setup->keypair = new_keypair;
+    setup->waiting_for_keypair = true;
+
+    // upload the public key so data-web has an up-to-date key
+    // setup a multipart upload to send up the public key
+    QHttpMultiPart* request_multipart = new QHttpMultiPart(QHttpMultiPart::FormDataType);
+
+    QHttpPart public_key_part;
+    public_key_part.setHeader(QNetworkRequest::ContentTypeHeader, QVariant("application/octet-stream"));
+    public_key_part.setHeader(QNetworkRequest::ContentDispositionHeader,
+                        QVariant("form-data; name=\"public_key\"; filename=\"public_key\""));
+    public_key_part.setBody(setup->keypair.public_key);
+    request_multipart->append(public_key_part);
+
+    const QByteArray HIGH_FIDELITY_USER_AGENT = "Mozilla/5.0 (HighFidelityInterface)";
+    const auto METAVERSE_SESSION_ID_HEADER = QString("HFM-SessionID").toLocal8Bit();
+    const QByteArray ACCESS_TOKEN_AUTHORIZATION_HEADER = "Authorization";
+
+    QNetworkRequest request;
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    request.setHeader(QNetworkRequest::UserAgentHeader, HIGH_FIDELITY_USER_AGENT);
+    request.setRawHeader(METAVERSE_SESSION_ID_HEADER, uuidStringWithoutCurlyBraces(session_id).toLocal8Bit());
+    if (setup->token != "") {
+        request.setRawHeader(ACCESS_TOKEN_AUTHORIZATION_HEADER, QString("Bearer %1").arg(setup->token).toUtf8());
+    }
+    request.setUrl(QUrl(MetaverseClient::METAVERSE_URL + "/api/v1/user/public_key"));
 
-            QNetworkReply* reply = NULL;
-            reply = nam->put(request, request_multipart);
+    QNetworkReply* reply = MetaverseClient::ForCurrentThread().Put(request, request_multipart);
 
-            connect(reply, SIGNAL(finished()), this, SLOT(KeypairRequestFinished()));
-        }
+    connect(reply, SIGNAL(finished()), this, SLOT(KeypairRequestFinished()));
+}
 
+void HifiConnection::UsernameSigned(QByteArray signature)
+{
+    if (!setup) {
+        return;
+    }
+    setup->signing_username = false;
+    setup->username_signature = signature;
+
+    if (signature.isEmpty()) {
+        qDebug() << "Error signing username with connection token";
+        qDebug() << "Will re-attempt on next domain-server check in.";
+        return;
+    }
+
+    qDebug() << "Returning username" << setup->username
+        << "signed with connection UUID" << uuidStringWithoutCurlyBraces(setup->signed_connection_token);
+
+    // Don't wait for the next timer tick
+    if (!domain_connected) {
+        SendDomainCheckInRequest();
+    }
+}
+
+void HifiConnection::SendDomainCheckInRequest(quint32 s)
+{
+    // The keypair and signing flags are plain members, they rely on every check in running on this thread
+    Q_ASSERT_X(QThread::currentThread() == thread(), "HifiConnection::SendDomainCheckInRequest", "called off the connection thread");
+
+    if (!finished_domain_id_request) {
+        return;
+    }
+
+    // Only a connect request carries the username, and the setup state is gone once connected
+    ConnectionSetup * connect_setup = domain_connected ? nullptr : setup.get();
+    bool requires_username_signature = connect_setup && !connect_setup->domain_connection_token.isNull();
+
+    // Take a pregenerated keypair, KeypairReady() uploads its public key and check ins resume once that is done
+    if (requires_username_signature && connect_setup->keypair.IsNull()) {
+        if (!connect_setup->taking_keypair) {
+            qDebug() << "HifiConnection::SendDomainCheckInRequest() - Taking keypair for username signature";
+            num_requests = 0;
+            connect_setup->taking_keypair = true;
+            connect_setup->username_signature = QByteArray();
+            RSAKeypairPool::Instance().Take(this, "KeypairReady");
+        }
+        return;
+    }
+    if (connect_setup && connect_setup->waiting_for_keypair) return;
+
+    // Signing runs on a pool thread, UsernameSigned() checks in again with the signature
+    if (requires_username_signature && connect_setup->username != "" &&
+            (connect_setup->username_signature.isEmpty() || connect_setup->signed_connection_token != connect_setup->domain_connection_token)) {
+        if (!connect_setup->signing_username) {
+            connect_setup->signing_username = true;
+            connect_setup->username_signature = QByteArray();
+            connect_setup->signed_connection_token = connect_setup->domain_connection_token;
+
+            QByteArray plaintext = connect_setup->username.toLower().toUtf8().append(connect_setup->domain_connection_token.toRfc4122());
+            RSAKeypairPool::Instance().Sign(connect_setup->keypair, plaintext, this, "UsernameSigned");
+        }
         return;
     }
-    if (waiting_for_keypair) return;
 
     PacketType packet_type = (domain_connected) ? PacketType::DomainListRequest : PacketType::DomainConnectRequest;
     std::unique_ptr<Packet> domain_checkin_request_packet = Packet::Create(s,packet_type);
@@ -973,60 +1094,11 @@ void HifiConnection::SendDomainCheckInRequest(uint32_t s)
     domain_checkin_data_stream << owner_type.load() << public_address << public_port <<local_address << local_port
                                << node_types_of_interest.toList() << domain_place_name;
 
-    if (!domain_connected && username != "") {
-        domain_checkin_data_stream << username;
+    if (connect_setup && connect_setup->username != "") {
+        domain_checkin_data_stream << connect_setup->username;
 
         // if this is a connect request, and we can present a username signature, send it along
-
-        if (!keypair_generator->GetPrivateKey().isEmpty()) {
-            QByteArray plaintext = username.toLower().toUtf8().append(domain_connection_token.toRfc4122());
-
-            //Sign plaintext
-            if (!keypair_generator->GetPrivateKey().isEmpty()) {
-                const char* private_key_data = keypair_generator->GetPrivateKey().constData();
-                RSA* rsa_private_key = d2i_RSAPrivateKey(NULL,
-                                                       reinterpret_cast<const unsigned char**>(&private_key_data),
-                                                       keypair_generator->GetPrivateKey().size());
-                if (rsa_private_key) {
-                    QByteArray signature(RSA_size(rsa_private_key), 0);
-                    unsigned int signature_bytes = 0;
-
-                    QByteArray hashed_plaintext = QCryptographicHash::hash(plaintext, QCryptographicHash::Sha256);
-
-                    int encrypt_return = RSA_sign(NID_sha256,
-                                                 reinterpret_cast<const unsigned char*>(hashed_plaintext.constData()),
-                                                 hashed_plaintext.size(),
-                                                 reinterpret_cast<unsigned char*>(signature.data()),
-                                                 &signature_bytes,
-                                                 rsa_private_key);
-
-                    // free the private key RSA struct now that we are done with it
-                    RSA_free(rsa_private_key);
-
-                    if (encrypt_return != -1) {
-                        username_signature = signature;
-                        //qDebug() << username_signature;
-                    }
-                    else {
-                        username_signature = QByteArray();
-                    }
-                } else {
-                    qDebug() << "Could not create RSA struct from QByteArray private key.";
-                }
-            }
-            else {
-                username_signature = QByteArray();
-            }
-
-            if (!username_signature.isEmpty()) {
-                qDebug() << "Returning username" << username
-                    << "signed with connection UUID" << uuidStringWithoutCurlyBraces(domain_connection_token);
-            } else {
-                qDebug() << "Error signing username with connection token";
-                qDebug() << "Will re-attempt on next domain-server check in.";
-            }
-        }
-
+        const QByteArray& username_signature = connect_setup->username_signature;
         if (requires_username_signature && !username_signature.isEmpty()) {
             domain_checkin_data_stream << username_signature;
         }
@@ -1040,7 +1112,7 @@ void HifiConnection::SendDomainCheckInRequest(uint32_t s)
     SendServerMessage(domain_checkin_request_packet->GetData(), domain_checkin_request_packet->GetDataSize(), domain_public_address, domain_public_port);
 }
 
-void HifiConnection::SendIcePing(uint32_t s, quint8 ping_type)
+void HifiConnection::SendIcePing(quint32 s, quint8 ping_type)
 {
     int packet_size = NUM_BYTES_RFC4122_UUID + sizeof(quint8);
 
@@ -1053,7 +1125,7 @@ void HifiConnection::SendIcePing(uint32_t s, quint8 ping_type)
     SendServerMessage(ice_ping->GetData(), ice_ping->GetDataSize(), (ping_type == 1)?domain_local_address:domain_public_address, (ping_type == 1)?domain_local_port:domain_public_port);
 }
 
-void HifiConnection::SendIcePingReply(uint32_t s, quint8 ping_type)
+void HifiConnection::SendIcePingReply(quint32 s, quint8 ping_type)
 {
     int packet_size = NUM_BYTES_RFC4122_UUID + sizeof(quint8);
     std::unique_ptr<Packet> ice_ping_reply = Packet::Create(s, PacketType::ICEPingReply, packet_size);
@@ -1072,7 +1144,7 @@ void HifiConnection::SendIcePingReply(uint32_t s, quint8 ping_type)
 void HifiConnection::ClientMessageReceived(const QString &message)
 {
     //qDebug() << "HifiConnection::ClientMessageReceived() - " << message;
-    if (started_hifi_connect) return;
+    if (started_hifi_connect || !setup) return;
 
     QJsonDocument doc;
     doc = QJsonDocument::fromJson(message.toLatin1());
@@ -1084,6 +1156,7 @@ void HifiConnection::ClientMessageReceived(const QString &message)
 
     if (type == "domain") {
         // Domain ID lookup
+        QString& domain_name = setup->domain_name;
         if (domain_name == "") {
             domain_name = obj["domain_name"].toString();
 
@@ -1093,19 +1166,17 @@ void HifiConnection::ClientMessageReceived(const QString &message)
 
             qDebug() << "HifiConnection::ClientMessageReceived - Looking up domain ID for domain: " << domain_name;
 
-            QNetworkAccessManager * nam = new QNetworkAccessManager(this);
-            QNetworkRequest id_request("https://metaverse.highfidelity.com/api/v1/places/" + domain_name);
-            id_request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-            QNetworkReply * reply = nam->get(id_request);
-            connect(reply, SIGNAL(finished()), this, SLOT(DomainRequestFinished()));
+            PlaceLookupCache::Instance().Lookup(domain_name, this, [this](const PlaceInfo& place) {
+                PlaceLookupFinished(place);
+            });
         }
 
+        QString& username = setup->username;
         if (username == "") {
             if (obj.keys().contains("username") && obj.keys().contains("password")) {
                 username = obj["username"].toString();
-                password = obj["password"].toString();
+                setup->password = obj["password"].toString();
 
-                QNetworkAccessManager * nam = new QNetworkAccessManager(this);
                 QNetworkRequest user_request;
                 const QByteArray HIGH_FIDELITY_USER_AGENT = "Mozilla/5.0 (HighFidelityInterface)";
                 const QString ACCOUNT_MANAGER_REQUESTED_SCOPE = "owner";
@@ -1115,18 +1186,30 @@ void HifiConnection::ClientMessageReceived(const QString &message)
                 QByteArray post_data;
                 post_data.append("grant_type=password&");
                 post_data.append("username=" + username + "&");
-                post_data.append("password=" + QUrl::toPercentEncoding(password) + "&");
+                post_data.append("password=" + QUrl::toPercentEncoding(setup->password) + "&");
                 post_data.append("scope=" + ACCOUNT_MANAGER_REQUESTED_SCOPE);
 
-                user_request.setUrl(QUrl("https://metaverse.highfidelity.com/oauth/token"));
+                user_request.setUrl(QUrl(MetaverseClient::METAVERSE_URL + "/oauth/token"));
                 user_request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
 
-                QNetworkReply* reply = nam->post(user_request, post_data);
+                QNetworkReply* reply = MetaverseClient::ForCurrentThread().Post(user_request, post_data);
                 connect(reply, &QNetworkReply::finished, this, &HifiConnection::RequestAccessTokenFinished);
                 connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(RequestAccessTokenError(QNetworkReply::NetworkError)));
             }
         }
     }
+    else if (type == "framing") {
+        // Client opts in to receiving framed data channel messages, framed messages from the client are always accepted
+        client_framing_enabled = true;
+        qDebug() << "HifiConnection::ClientMessageReceived() - Client enabled message framing";
+
+        QJsonObject framing_object;
+        framing_object.insert("type", QJsonValue::fromVariant("framing"));
+        framing_object.insert("enabled", QJsonValue::fromVariant(true));
+        framing_object.insert("max_message_size", QJsonValue::fromVariant(MessageFraming::MAX_FRAMED_MESSAGE_SIZE));
+        QJsonDocument framingDoc(framing_object);
+        if (this->client_socket) client_socket->sendTextMessage(QString::fromStdString(framingDoc.toJson(QJsonDocument::Compact).toStdString()));
+    }
     else if (type == "offer") {
         std::function<void(rtcdcpp::PeerConnection::IceCandidate)> onLocalIceCandidate = [this](rtcdcpp::PeerConnection::IceCandidate candidate) {
             if (QString::fromStdString(candidate.candidate) != "") {
@@ -1150,17 +1233,28 @@ void HifiConnection::ClientMessageReceived(const QString &message)
             if (label == "datachannel") {
                 qDebug() << "HifiConnection::onDataChannel() - Registering domain server data channel";
                 data_channel = channel;
-            }
 
-            if (this->data_channel && this->finished_domain_id_request && !this->started_hifi_connect) {
-                qDebug() << "HifiConnection::WebRTCConnectionReady() - Data channels registered";
-                started_hifi_connect = true;
-                Q_EMIT WebRTCConnectionReady();
+                // Called on a library thread, the rest of the bring-up happens on ours
+                QMetaObject::invokeMethod(this, "AdvanceBringUp", Qt::QueuedConnection);
             }
         };
 
         rtcdcpp::RTCConfiguration config;
-        config.ice_servers.emplace_back(rtcdcpp::RTCIceServer{"stun.l.google.com", 19302});
+        // Only ever hand libnice an address, given a hostname it would block this thread in getaddrinfo.
+        // Until the cache has resolved it the peer goes without a STUN server and offers its host candidates only.
+        const QHostAddress webrtc_stun_address = HostResolverCache::Instance().GetAddress(WEBRTC_STUN_SERVER_HOSTNAME);
+        if (!webrtc_stun_address.isNull()) {
+            config.ice_servers.emplace_back(rtcdcpp::RTCIceServer{webrtc_stun_address.toString().toStdString(), WEBRTC_STUN_SERVER_PORT});
+        }
+        else {
+            qDebug() << "HifiConnection::ClientMessageReceived() -" << WEBRTC_STUN_SERVER_HOSTNAME << "not resolved yet, creating peer without a STUN server";
+        }
+
+        // Every peer presents the relay's certificate, the library would generate one per peer otherwise
+        std::shared_ptr<const rtcdcpp::RTCCertificate> certificate = CertificateStore::Instance().GetCertificate();
+        if (certificate) {
+            config.certificates.push_back(*certificate);
+        }
 
         remote_peer_connection = std::make_shared<rtcdcpp::PeerConnection>(config, onLocalIceCandidate, onDataChannel);
 
@@ -1184,22 +1278,3 @@ void HifiConnection::ServerDisconnected()
 {
     Q_EMIT Disconnected();
 }
-
-Node * HifiConnection::GetNodeFromAddress(QHostAddress sender, quint16 sender_port)
-{
-    Node * node = nullptr;
-    if (audio_mixer && audio_mixer->CheckNodeAddress(sender, sender_port))
-        node = audio_mixer;
-    else if (avatar_mixer && avatar_mixer->CheckNodeAddress(sender, sender_port))
-        node = avatar_mixer;
-    else if (asset_server && asset_server->CheckNodeAddress(sender, sender_port))
-        node = asset_server;
-    else if (messages_mixer && messages_mixer->CheckNodeAddress(sender, sender_port))
-        node = messages_mixer;
-    else if (entity_script_server && entity_script_server->CheckNodeAddress(sender, sender_port))
-        node = entity_script_server;
-    else if (entity_server && entity_server->CheckNodeAddress(sender, sender_port))
-        node = entity_server;
-
-    return node;
-}
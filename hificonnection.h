@@ -24,14 +24,74 @@
 #endif //Q_OS_UNIX
 
 #include "packet.h"
+#include "packetview.h"
 #include "node.h"
+#include "noderoutingtable.h"
+#include "datagrambatch.h"
+#include "messageframing.h"
 #include "utils.h"
-#include "rsakeypairgenerator.h"
+#include "rsakeypairpool.h"
+#include "metaverseclient.h"
+#include "placelookupcache.h"
+#include "hostresolvercache.h"
+#include "certificatestore.h"
 
 #include "portableendian.h"
 
 #include <rtcdcpp/PeerConnection.hpp>
 
+// Bytes one connection holds, by component. Only what the relay allocates itself is counted,
+// the OpenSSL, libnice and usrsctp state behind the peer connection is covered in the readme.
+struct ConnectionFootprint
+{
+    size_t connection; // the HifiConnection itself, routing table and framing buffer included
+    size_t setup;      // 0 once the domain server has accepted us
+    size_t nodes;
+    size_t send_batch;
+
+    size_t GetTotal() const {return connection + setup + nodes + send_batch;}
+};
+
+// State that is only needed while the connection is being brought up. It is kept in a side allocation
+// and released as soon as the domain server sends its first DomainList, so connected clients carry none of it.
+// None of it is synchronized, it is only read and written on the connection's thread.
+struct ConnectionSetup
+{
+    QString username;
+    QString password;
+    QString domain_name;
+    QString stun_server_hostname;
+    QString ice_server_hostname;
+
+    QString token;
+    QString refreshToken;
+    qlonglong expiryTimestamp;
+    QString tokenType;
+
+    QUuid domain_connection_token;
+    QByteArray username_signature;
+    QUuid signed_connection_token; // the token username_signature was made for
+    // Keep a check in from taking a second keypair or signing the same token twice while a pool thread works
+    bool taking_keypair;
+    bool waiting_for_keypair;
+    bool signing_username;
+    RSAKeypair keypair;
+
+    // Bring-up, each step starts as soon as its own inputs exist (see AdvanceBringUp())
+    QElapsedTimer bring_up_timer;
+    bool stun_finished;
+    bool started_ice;
+    bool ice_finished;
+    QByteArray stun_response; // for the client, held until its data channel is registered
+
+    // Children of the connection, retrying requests until the matching response arrives
+    QTimer * stun_response_timer;
+    QTimer * ice_response_timer;
+    QTimer * hifi_response_timer;
+
+    size_t GetMemoryFootprint() const;
+};
+
 class HifiConnection : public QObject
 {
     Q_OBJECT
@@ -40,8 +100,6 @@ public:
     HifiConnection(QWebSocket * s);
     ~HifiConnection();
 
-    void HandleLookupResult(const QHostInfo& hostInfo, QString addr_type);
-
     void UpdateLocalSocket();
     QHostAddress GetGuessedLocalAddress();
 
@@ -58,29 +116,56 @@ public:
 
     void Stop();
 
-    void SendIcePing(uint32_t s, quint8 ping_type);
-    void SendIcePingReply(uint32_t s, quint8 ping_type);
-    void SendDomainCheckInRequest(uint32_t s = 0);
-
     void ParseNodeFromPacketStream(QDataStream& packet_stream);
 
-    void SendServerMessage(QByteArray message, QHostAddress address, quint16 port) {if (hifi_socket) hifi_socket->writeDatagram(message, address, port);}
-    void SendServerMessage(char * message, int len, QHostAddress address, quint16 port) {if (hifi_socket) hifi_socket->writeDatagram(message, len, address, port);}
+    void SendServerMessage(const QByteArray& message, const QHostAddress& address, quint16 port) {if (hifi_socket) hifi_socket->writeDatagram(message, address, port);}
+    void SendServerMessage(const char * message, int len, const QHostAddress& address, quint16 port) {if (hifi_socket) hifi_socket->writeDatagram(message, len, address, port);}
+    void SendServerMessage(const char * message, int len, const NodeRoute& route) {
+        switch (server_send_batch.Enqueue(message, len, route.address)) {
+        case DatagramSendBatch::FirstInBatch:
+        case DatagramSendBatch::BatchFull:
+            // Flush once the event loop is idle, so the rest of this burst goes out in the same sendmmsg.
+            // Always queued: this runs on the data channel thread and hifi_socket belongs to the connection thread.
+            QMetaObject::invokeMethod(this, "FlushServerMessages", Qt::QueuedConnection);
+            break;
+        default:
+            break;
+        }
+    }
 
-    void SendClientMessageFromNode(NodeType_t node_type, QByteArray data) {
-        data.push_front((char) node_type);
-        SendClientMessage(data.data(), data.size());
+    void SendClientMessageFromNode(NodeType_t node_type, const char * data, int len) {
+        if (client_framing_enabled) {
+            if (!client_message_writer.Fits(len)) {
+                FlushClientMessages();
+            }
+            if (client_message_writer.Fits(len)) {
+                client_message_writer.Append(node_type, data, len);
+                return;
+            }
+            // Too large to frame, send it on its own
+        }
+
+        // Sent as [node type][datagram] straight from the receive buffer, no contiguous copy is built here
+        const rtcdcpp::IoVec message[2] = {{&node_type, sizeof(NodeType_t)}, {data, (size_t) len}};
+        if (data_channel) data_channel->SendBinary(message, 2);
+    }
+    void FlushClientMessages() {
+        if (client_message_writer.IsEmpty()) return;
+        if (data_channel) data_channel->SendBinary((const uint8_t *) client_message_writer.GetData(), client_message_writer.GetSize());
+        client_message_writer.Clear();
     }
     void SendClientMessage(char * data, int len) {if (data_channel) data_channel->SendBinary((const uint8_t *) data, len);}
 
-    Node * GetNodeFromAddress(QHostAddress sender, quint16 sender_port);
+    // Runs on the data channel thread. Proxied requests are queued to the connection thread, anything else is forwarded.
+    void ProcessClientPacket(NodeType_t server, const char * packet, int packet_size);
+    bool ProcessServerDatagram(const char * data, int size, quint32 sender_ipv4, quint16 sender_port);
+    void ParseDatagram(const PacketView& view);
 
-    void ParseDatagram(QByteArray response_packet);
+    ConnectionFootprint GetMemoryFootprint();
 
 Q_SIGNALS:
 
     void Disconnected();
-    void WebRTCConnectionReady();
 
     void StunFinished();
     void IceFinished();
@@ -89,12 +174,19 @@ public Q_SLOTS:
 
     void Timeout();
 
+    // Connection thread only, they read the bring-up state and write to hifi_socket
+    void SendIcePing(quint32 s, quint8 ping_type);
+    void SendIcePingReply(quint32 s, quint8 ping_type);
+    void SendDomainCheckInRequest(quint32 s = 0);
+
     void ConnectedForLocalSocketTest();
     void ErrorTestingLocalSocket();
 
-    void DomainRequestFinished();
     void KeypairRequestFinished();
+    void KeypairReady(RSAKeypair new_keypair);
+    void UsernameSigned(QByteArray signature);
 
+    void AdvanceBringUp();
     void StartIce();
     void StartStun();
     void StartDomainConnect();
@@ -103,6 +195,7 @@ public Q_SLOTS:
     void SendIceRequest();
     void SendDomainCheckIn();
     void ParseHifiResponse();
+    void FlushServerMessages() {if (hifi_socket) server_send_batch.Flush(hifi_socket->socketDescriptor());}
 
     void ClientMessageReceived(const QString &message);
     void ServerDisconnected();
@@ -117,13 +210,18 @@ private:
         return uuid_string_no_braces;
     }
 
+    void ReleaseSetup();
+    void SetupDataChannel();
+    void FinishStun(const char * response, int size);
+    void LogBringUp(const char * stage);
+    void PlaceLookupFinished(const PlaceInfo& place);
+
     bool has_tcp_checked_local_socket;
 
+    std::unique_ptr<ConnectionSetup> setup;
+
     QUdpSocket * hifi_socket;
     QTimer * timeout_timer;
-    QTimer * stun_response_timer;
-    QTimer * ice_response_timer;
-    QTimer * hifi_response_timer;
 
     QHostAddress public_address;
     quint16 public_port;
@@ -134,7 +232,6 @@ private:
 
     bool started_hifi_connect;
 
-    RSAKeypairGenerator * keypair_generator;
     bool has_completed_current_request;
     bool domain_connected;
     uint32_t num_requests;
@@ -147,11 +244,6 @@ private:
     std::atomic<NodeType_t> owner_type;
     NodeSet node_types_of_interest;
 
-    QString username;
-    QString password;
-    QUuid domain_connection_token;
-    QByteArray username_signature;
-    bool waiting_for_keypair;
     bool started_domain_connect;
 
     QUuid session_id;
@@ -159,38 +251,30 @@ private:
 
     Permissions permissions;
 
-    Node * asset_server;
-    Node * audio_mixer;
-    Node * avatar_mixer;
-    Node * messages_mixer;
-    Node * entity_server;
-    Node * entity_script_server;
+    QHash<NodeType_t, Node *> nodes;
+    NodeRoutingTable routing_table;
+    DatagramSendBatch server_send_batch;
 
     QWebSocket * client_socket;
     std::shared_ptr<rtcdcpp::PeerConnection> remote_peer_connection;
 
     std::shared_ptr<rtcdcpp::DataChannel> data_channel;
 
+    bool client_framing_enabled;
+    FramedMessageWriter client_message_writer;
+
     bool finished_domain_id_request;
-    QString domain_name;
     QString domain_place_name;
     QUuid domain_id;
 
-    QString stun_server_hostname;
     QHostAddress stun_server_address;
     quint16 stun_server_port;
 
-    QString ice_server_hostname;
     QHostAddress ice_server_address;
     quint16 ice_server_port;
 
     quint64 client_timestamp;
     quint64 server_timestamp;
-
-    QString token;
-    QString refreshToken;
-    qlonglong expiryTimestamp;
-    QString tokenType;
 };
 
 #endif // HIFICONNECTION_H
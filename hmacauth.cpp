@@ -1,28 +1,65 @@
 #include "hmacauth.h"
 
+namespace {
 #if OPENSSL_VERSION_NUMBER >= 0x10100000
-HMACAuth::HMACAuth(AuthMethod authMethod)
-    : hmac_context(HMAC_CTX_new())
-    , auth_method(authMethod) { }
+    HMAC_CTX * NewContext()
+    {
+        return HMAC_CTX_new();
+    }
 
-HMACAuth::~HMACAuth()
-{
-    HMAC_CTX_free(hmac_context);
-}
+    void FreeContext(HMAC_CTX * context)
+    {
+        HMAC_CTX_free(context);
+    }
+
+    bool CopyContext(HMAC_CTX * destination, HMAC_CTX * source)
+    {
+        // Reuses the digest buffers destination already has
+        return (bool) HMAC_CTX_copy(destination, source);
+    }
 
 #else
 
-HMACAuth::HMACAuth(AuthMethod auth_method)
-    : hmac_context(new HMAC_CTX())
-    , auth_method(auth_method) {
-    HMAC_CTX_init(hmac_context);
+    HMAC_CTX * NewContext()
+    {
+        HMAC_CTX * context = new HMAC_CTX();
+        HMAC_CTX_init(context);
+        return context;
+    }
+
+    void FreeContext(HMAC_CTX * context)
+    {
+        HMAC_CTX_cleanup(context);
+        delete context;
+    }
+
+    bool CopyContext(HMAC_CTX * destination, HMAC_CTX * source)
+    {
+        // 1.0 overwrites the destination without freeing what it held
+        HMAC_CTX_cleanup(destination);
+        return (bool) HMAC_CTX_copy(destination, source);
+    }
+#endif
+
+    struct ScratchContext {
+        HMAC_CTX * context;
+
+        ScratchContext() : context(NewContext()) { }
+        ~ScratchContext() { FreeContext(context); }
+    };
+
+    thread_local ScratchContext scratch;
 }
 
-HMACAuth::~HMACAuth() {
-    HMAC_CTX_cleanup(hmac_context);
-    delete hmac_context;
+HMACAuth::HMACAuth(AuthMethod authMethod)
+    : keyed_context(NewContext())
+    , has_key(false)
+    , auth_method(authMethod) { }
+
+HMACAuth::~HMACAuth()
+{
+    FreeContext(keyed_context);
 }
-#endif
 
 bool HMACAuth::SetKey(const char* keyValue, int keyLen) {
     const EVP_MD* ssl_struct = nullptr;
@@ -52,8 +89,11 @@ bool HMACAuth::SetKey(const char* keyValue, int keyLen) {
         return false;
     }
 
-    QMutexLocker lock(&_lock);
-    return (bool) HMAC_Init_ex(hmac_context, keyValue, keyLen, ssl_struct, nullptr);
+    has_key = (bool) HMAC_Init_ex(keyed_context, keyValue, keyLen, ssl_struct, nullptr);
+    if (has_key && auth_method == MD5) {
+        MultiBufferHMAC::PrepareMD5Key(reinterpret_cast<const unsigned char*>(keyValue), keyLen, md5_key_state);
+    }
+    return has_key;
 }
 
 bool HMACAuth::SetKey(const QUuid& uidKey) {
@@ -61,37 +101,62 @@ bool HMACAuth::SetKey(const QUuid& uidKey) {
     return SetKey(rfcBytes.constData(), rfcBytes.length());
 }
 
-bool HMACAuth::AddData(const char* data, int data_len) {
-    QMutexLocker lock(&_lock);
-    return (bool) HMAC_Update(hmac_context, reinterpret_cast<const unsigned char*>(data), data_len);
-}
+bool HMACAuth::CalculateHash(HMACHash& hash_result, const char* data, int data_len) const {
+    if (!has_key) {
+        qDebug() << "HMACAuth::CalculateHash() - No key set";
+        return false;
+    }
 
-HMACAuth::HMACHash HMACAuth::Result() {
-    HMACHash hash_value(EVP_MAX_MD_SIZE);
-    unsigned int hash_len;
-    QMutexLocker lock(&_lock);
+    // Start from the keyed state instead of keying again
+    HMAC_CTX * context = scratch.context;
+    if (!CopyContext(context, keyed_context)) {
+        qDebug() << "Error occured copying the keyed HMAC context";
+        return false;
+    }
 
-    auto hmac_result = HMAC_Final(hmac_context, &hash_value[0], &hash_len);
+    if (!HMAC_Update(context, reinterpret_cast<const unsigned char*>(data), data_len)) {
+        qDebug() << "Error occured calling HMAC_Update";
+        return false;
+    }
 
-    if (hmac_result) {
-        hash_value.resize((size_t)hash_len);
-    } else {
+    unsigned int hash_len = 0;
+    hash_result.resize(EVP_MAX_MD_SIZE);
+    if (!HMAC_Final(context, &hash_result[0], &hash_len)) {
         // the HMAC_FINAL call failed - should not be possible to get into this state
         qDebug() << "Error occured calling HMAC_Final";
+        return false;
     }
 
-    // Clear state for possible reuse.
-    HMAC_Init_ex(hmac_context, nullptr, 0, nullptr, nullptr);
-    return hash_value;
+    hash_result.resize((size_t) hash_len);
+    return true;
 }
 
-bool HMACAuth::CalculateHash(HMACHash& hash_result, const char* data, int data_len) {
-    QMutexLocker lock(&_lock);
-    if (!AddData(data, data_len)) {
-        qDebug() << "Error occured calling HMACAuth::addData()";
+bool HMACAuth::CalculateHashes(HMACHash* hash_results, const char* const* data, const int* data_lens, int count) const {
+    if (!has_key) {
+        qDebug() << "HMACAuth::CalculateHashes() - No key set";
         return false;
     }
 
-    hash_result = Result();
+    int index = 0;
+    if (auth_method == MD5 && MultiBufferHMAC::IsAvailable()) {
+        // A single buffer is cheaper through OpenSSL than through seven idle lanes
+        while (count - index >= 2) {
+            const int num_lanes = qMin(count - index, MultiBufferHMAC::MD5_LANES);
+            unsigned char digests[MultiBufferHMAC::MD5_LANES][MultiBufferHMAC::MD5_DIGEST_SIZE];
+            MultiBufferHMAC::HMACMD5(md5_key_state, reinterpret_cast<const unsigned char* const*>(data + index),
+                                     data_lens + index, num_lanes, digests);
+
+            for (int i = 0; i < num_lanes; i++) {
+                hash_results[index + i].assign(digests[i], digests[i] + MultiBufferHMAC::MD5_DIGEST_SIZE);
+            }
+            index += num_lanes;
+        }
+    }
+
+    for (; index < count; index++) {
+        if (!CalculateHash(hash_results[index], data[index], data_lens[index])) {
+            return false;
+        }
+    }
     return true;
 }
@@ -5,7 +5,6 @@
 #include <memory>
 #include <QDebug>
 #include <QObject>
-#include <QtCore/QMutex>
 
 #include <openssl/opensslv.h>
 #include <openssl/hmac.h>
@@ -13,6 +12,11 @@
 #include <QUuid>
 #include <cassert>
 
+#include "multibufferhmac.h"
+
+// HMAC keyed once in SetKey(). The keyed inner/outer digest state is kept and copied into a
+// thread-local context for every hash, so threads can sign and verify with the same instance
+// at the same time without a lock, and no key setup happens per packet.
 class HMACAuth {
 public:
     enum AuthMethod { MD5, SHA1, SHA224, SHA256, RIPEMD160 };
@@ -21,22 +25,24 @@ public:
     explicit HMACAuth(AuthMethod auth_method = MD5);
     ~HMACAuth();
 
+    // Must not run while another thread is hashing with this instance
     bool SetKey(const char* keyValue, int keyLen);
     bool SetKey(const QUuid& uidKey);
+
     // Calculate complete hash in one.
-    bool CalculateHash(HMACHash& hashResult, const char* data, int dataLen);
+    bool CalculateHash(HMACHash& hashResult, const char* data, int dataLen) const;
 
-    // Append to data to be hashed.
-    bool AddData(const char* data, int dataLen);
-    // Get the resulting hash from calls to addData().
-    // Note that only one hash may be calculated at a time for each
-    // HMACAuth instance if this interface is used.
-    HMACHash Result();
+    // Hashes count independent buffers into hash_results. MD5 keys hash up to eight buffers per pass
+    // when the CPU has AVX2; everything else goes through CalculateHash() one buffer at a time.
+    bool CalculateHashes(HMACHash* hash_results, const char* const* data, const int* data_lens, int count) const;
 
 private:
-    QMutex _lock { QMutex::Recursive };
-    struct hmac_ctx_st* hmac_context;
+    struct hmac_ctx_st* keyed_context;
+    bool has_key;
     AuthMethod auth_method;
+
+    // Raw MD5 ipad/opad state for the multi-buffer path, set alongside keyed_context
+    MultiBufferHMAC::MD5KeyState md5_key_state;
 };
 
 #endif // HMACAUTH_H
@@ -0,0 +1,117 @@
+#include "hostresolvercache.h"
+
+HostResolverCache& HostResolverCache::Instance()
+{
+    static HostResolverCache cache;
+    return cache;
+}
+
+HostResolverCache::HostResolverCache()
+{
+    connect(&refresh_timer, &QTimer::timeout, this, &HostResolverCache::Refresh);
+    refresh_timer.start(REFRESH_INTERVAL_MSEC);
+}
+
+void HostResolverCache::AddHost(const QString& hostname)
+{
+    const QString key = hostname.toLower();
+    {
+        QMutexLocker lock(&mutex);
+        Entry& entry = entries[key];
+        if (entry.is_override || entry.looking_up || !entry.address.isNull()) {
+            return;
+        }
+        entry.looking_up = true;
+    }
+
+    // Hostnames that are already addresses need no lookup
+    const QHostAddress literal(hostname);
+    if (!literal.isNull()) {
+        QMutexLocker lock(&mutex);
+        entries[key].address = literal;
+        entries[key].looking_up = false;
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, "StartLookup", Qt::QueuedConnection, Q_ARG(QString, key));
+}
+
+void HostResolverCache::SetOverride(const QString& hostname, const QHostAddress& address)
+{
+    QMutexLocker lock(&mutex);
+    Entry& entry = entries[hostname.toLower()];
+    entry.address = address;
+    entry.is_override = true;
+
+    qDebug() << "HostResolverCache::SetOverride() -" << hostname << "resolves to" << address.toString();
+}
+
+QHostAddress HostResolverCache::GetAddress(const QString& hostname)
+{
+    {
+        QMutexLocker lock(&mutex);
+        const QHostAddress address = entries.value(hostname.toLower()).address;
+        if (!address.isNull()) {
+            return address;
+        }
+    }
+
+    // Unknown, or the last lookup failed. AddHost() does nothing while one is already running,
+    // and fills in address literals straight away.
+    AddHost(hostname);
+
+    QMutexLocker lock(&mutex);
+    return entries.value(hostname.toLower()).address;
+}
+
+void HostResolverCache::StartLookup(QString hostname)
+{
+    qDebug() << "HostResolverCache::StartLookup() - Looking up IP address for hostname" << hostname;
+    const int lookup_id = QHostInfo::lookupHost(hostname, this, SLOT(LookupFinished(QHostInfo)));
+    lookup_hostnames.insert(lookup_id, hostname);
+}
+
+void HostResolverCache::LookupFinished(const QHostInfo& host_info)
+{
+    const QString hostname = lookup_hostnames.take(host_info.lookupId());
+
+    QHostAddress address;
+    if (host_info.error() != QHostInfo::NoError) {
+        qDebug() << "HostResolverCache::LookupFinished() - Lookup failed for" << hostname << ":" << host_info.errorString();
+    }
+    else {
+        for (int i = 0; i < host_info.addresses().size(); i++) {
+            // just take the first IPv4 address
+            if (host_info.addresses()[i].protocol() == QAbstractSocket::IPv4Protocol) {
+                address = host_info.addresses()[i];
+                break;
+            }
+        }
+    }
+
+    QMutexLocker lock(&mutex);
+    Entry& entry = entries[hostname];
+    entry.looking_up = false;
+    if (!address.isNull() && !entry.is_override && entry.address != address) {
+        qDebug() << "HostResolverCache::LookupFinished() -" << hostname << "is" << address.toString();
+        entry.address = address;
+    }
+}
+
+void HostResolverCache::Refresh()
+{
+    QStringList hostnames;
+    {
+        QMutexLocker lock(&mutex);
+        for (QHash<QString, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+            if (!it->is_override && !it->looking_up && QHostAddress(it.key()).isNull()) {
+                it->looking_up = true;
+                hostnames << it.key();
+            }
+        }
+    }
+
+    for (int i = 0; i < hostnames.size(); i++) {
+        StartLookup(hostnames[i]);
+    }
+}
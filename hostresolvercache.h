@@ -0,0 +1,58 @@
+#ifndef HOSTRESOLVERCACHE_H
+#define HOSTRESOLVERCACHE_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QTimer>
+#include <QtNetwork>
+
+// Process wide hostname -> IPv4 address cache for the servers every connection talks to (STUN, ICE).
+//
+// Lookups run asynchronously on the thread that owns the cache and are redone every REFRESH_INTERVAL_MSEC,
+// so connections only ever read the last known address and never wait on DNS. A failed refresh keeps the
+// previous address. Overrides (-resolve host ip) are never looked up and stand in for DNS entirely.
+class HostResolverCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int REFRESH_INTERVAL_MSEC = 5 * 60 * 1000;
+
+    // The first call decides which thread runs the lookups, make it from the main thread at startup
+    static HostResolverCache& Instance();
+
+    // Starts resolving hostname in the background and keeps it refreshed. Safe to call from any thread.
+    void AddHost(const QString& hostname);
+    void SetOverride(const QString& hostname, const QHostAddress& address);
+
+    // Last known address, or a null address if hostname has not resolved yet (a lookup is started then).
+    // Never blocks on the network, safe to call from any thread.
+    QHostAddress GetAddress(const QString& hostname);
+
+private Q_SLOTS:
+
+    void StartLookup(QString hostname);
+    void LookupFinished(const QHostInfo& host_info);
+    void Refresh();
+
+private:
+    struct Entry
+    {
+        QHostAddress address;
+        bool is_override;
+        bool looking_up;
+
+        Entry() : is_override(false), looking_up(false) { }
+    };
+
+    HostResolverCache();
+
+    QMutex mutex;
+    QHash<QString, Entry> entries;
+    QHash<int, QString> lookup_hostnames; // lookup ID -> hostname, owner thread only
+
+    QTimer refresh_timer;
+};
+
+#endif // HOSTRESOLVERCACHE_H
@@ -0,0 +1,61 @@
+#include <cstring>
+
+#include "messageframing.h"
+
+FramedMessageWriter::FramedMessageWriter()
+{
+    num_messages = 0;
+    total_frames = 0;
+    Clear();
+}
+
+void FramedMessageWriter::Append(NodeType_t node_type, const char * data, int len)
+{
+    char * frame = message + message_size;
+    frame[0] = (char) node_type;
+    frame[1] = (char) ((len >> 8) & 0xFF);
+    frame[2] = (char) (len & 0xFF);
+    memcpy(frame + MessageFraming::FRAME_HEADER_SIZE, data, len);
+
+    message_size += MessageFraming::FRAME_HEADER_SIZE + len;
+    ++num_frames;
+}
+
+void FramedMessageWriter::Clear()
+{
+    if (num_frames > 0) {
+        ++num_messages;
+        total_frames += num_frames;
+    }
+
+    message[0] = (char) MessageFraming::FRAMED_MESSAGE_MARKER;
+    message_size = 1;
+    num_frames = 0;
+}
+
+FramedMessageReader::FramedMessageReader(const char * data, int size)
+{
+    message = data;
+    message_size = size;
+    position = 1; // skip the marker
+}
+
+bool FramedMessageReader::Next(NodeType_t& node_type, const char *& data, int& len)
+{
+    if (position + MessageFraming::FRAME_HEADER_SIZE > message_size) {
+        return false;
+    }
+
+    const quint8 * frame = reinterpret_cast<const quint8 *>(message + position);
+    const int frame_len = (frame[1] << 8) | frame[2];
+    if (position + MessageFraming::FRAME_HEADER_SIZE + frame_len > message_size) {
+        return false;
+    }
+
+    node_type = frame[0];
+    data = message + position + MessageFraming::FRAME_HEADER_SIZE;
+    len = frame_len;
+
+    position += MessageFraming::FRAME_HEADER_SIZE + frame_len;
+    return true;
+}
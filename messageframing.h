@@ -0,0 +1,63 @@
+#ifndef MESSAGEFRAMING_H
+#define MESSAGEFRAMING_H
+
+#include <QtGlobal>
+
+#include "node.h"
+
+// Framed data channel messages pack several datagrams into one SCTP message:
+//
+//     [marker 0x00] ([node type][length, 16 bit network order][datagram])...
+//
+// A plain message starts with its node type instead, which is never 0, so both kinds can share a channel.
+namespace MessageFraming {
+    const quint8 FRAMED_MESSAGE_MARKER = 0x00;
+    const int FRAME_HEADER_SIZE = sizeof(NodeType_t) + sizeof(quint16);
+
+    // Keeps a framed message inside one SCTP packet on a typical path MTU once DTLS and SCTP headers are added
+    const int MAX_FRAMED_MESSAGE_SIZE = 1150;
+
+    inline bool IsFramedMessage(const char * data, int size) {return size > 0 && (quint8) data[0] == FRAMED_MESSAGE_MARKER;}
+}
+
+class FramedMessageWriter
+{
+public:
+    FramedMessageWriter();
+
+    // True when a datagram of len bytes can be appended without going over MAX_FRAMED_MESSAGE_SIZE
+    bool Fits(int len) const {return message_size + MessageFraming::FRAME_HEADER_SIZE + len <= MessageFraming::MAX_FRAMED_MESSAGE_SIZE;}
+    void Append(NodeType_t node_type, const char * data, int len);
+
+    bool IsEmpty() const {return num_frames == 0;}
+    const char * GetData() const {return message;}
+    int GetSize() const {return message_size;}
+    void Clear();
+
+    quint64 GetNumMessages() const {return num_messages;}
+    quint64 GetNumFrames() const {return total_frames;}
+
+private:
+    char message[MessageFraming::MAX_FRAMED_MESSAGE_SIZE];
+    int message_size;
+    int num_frames;
+
+    quint64 num_messages;
+    quint64 total_frames;
+};
+
+class FramedMessageReader
+{
+public:
+    FramedMessageReader(const char * data, int size);
+
+    // Returns false once all frames are read, or on a truncated frame
+    bool Next(NodeType_t& node_type, const char *& data, int& len);
+
+private:
+    const char * message;
+    int message_size;
+    int position;
+};
+
+#endif // MESSAGEFRAMING_H
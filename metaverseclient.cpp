@@ -0,0 +1,95 @@
+#include "metaverseclient.h"
+
+const QString MetaverseClient::METAVERSE_URL = "https://metaverse.highfidelity.com";
+
+QThreadStorage<MetaverseClient *> MetaverseClient::thread_clients;
+
+MetaverseClient& MetaverseClient::ForCurrentThread()
+{
+    if (!thread_clients.hasLocalData()) {
+        thread_clients.setLocalData(new MetaverseClient());
+    }
+    return *thread_clients.localData();
+}
+
+MetaverseClient::MetaverseClient() :
+    nam(new QNetworkAccessManager(this)),
+    num_requests(0),
+    num_finished(0),
+    num_failed(0),
+    num_timed_out(0),
+    total_latency_msec(0),
+    max_latency_msec(0)
+{
+    clock.start();
+
+    // Open the connection before the first client needs it
+    const QUrl url(METAVERSE_URL);
+    nam->connectToHostEncrypted(url.host(), (quint16) url.port(443));
+}
+
+QNetworkRequest MetaverseClient::Prepare(QNetworkRequest request)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+    // Negotiated through ALPN, requests to the same host then share one multiplexed connection
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+#endif
+    return request;
+}
+
+QNetworkReply * MetaverseClient::Track(QNetworkReply * reply)
+{
+    ++num_requests;
+    in_flight.insert(reply, clock.elapsed());
+
+    // Connected before the caller's own slots, so the metrics are up to date when they run
+    connect(reply, &QNetworkReply::finished, this, &MetaverseClient::RequestFinished);
+
+    QTimer * timeout_timer = new QTimer(reply);
+    timeout_timer->setSingleShot(true);
+    connect(timeout_timer, &QTimer::timeout, this, [this, reply]() {
+        if (reply->isRunning()) {
+            qDebug() << "MetaverseClient::Track() - Request timed out" << reply->url().toString();
+            ++num_timed_out;
+            reply->abort();
+        }
+    });
+    timeout_timer->start(REQUEST_TIMEOUT_MSEC);
+
+    return reply;
+}
+
+QNetworkReply * MetaverseClient::Get(QNetworkRequest request)
+{
+    return Track(nam->get(Prepare(request)));
+}
+
+QNetworkReply * MetaverseClient::Post(QNetworkRequest request, const QByteArray& data)
+{
+    return Track(nam->post(Prepare(request), data));
+}
+
+QNetworkReply * MetaverseClient::Put(QNetworkRequest request, QHttpMultiPart * multi_part)
+{
+    QNetworkReply * reply = nam->put(Prepare(request), multi_part);
+    // The body has to outlive the upload, let the reply take it
+    multi_part->setParent(reply);
+    return Track(reply);
+}
+
+void MetaverseClient::RequestFinished()
+{
+    QNetworkReply * reply = qobject_cast<QNetworkReply *>(sender());
+    if (!reply || !in_flight.contains(reply)) {
+        return;
+    }
+
+    const qint64 latency_msec = clock.elapsed() - in_flight.take(reply);
+    ++num_finished;
+    total_latency_msec += latency_msec;
+    max_latency_msec = qMax(max_latency_msec, latency_msec);
+
+    if (reply->error() != QNetworkReply::NoError) {
+        ++num_failed;
+    }
+}
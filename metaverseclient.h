@@ -0,0 +1,59 @@
+#ifndef METAVERSECLIENT_H
+#define METAVERSECLIENT_H
+
+#include <QObject>
+#include <QHash>
+#include <QThreadStorage>
+#include <QElapsedTimer>
+#include <QtNetwork>
+
+// All metaverse API calls made from one thread go through a single QNetworkAccessManager. It keeps
+// connections to the API host alive and reuses them, so a client joining after the first skips the
+// TCP and TLS handshakes. QNAM is bound to the thread it was created on, hence one per worker.
+class MetaverseClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const QString METAVERSE_URL;
+    static const int REQUEST_TIMEOUT_MSEC = 10000;
+
+    static MetaverseClient& ForCurrentThread();
+
+    // The reply belongs to the client's manager, callers still deleteLater() it once finished.
+    // A request still running after REQUEST_TIMEOUT_MSEC is aborted and finishes with OperationCanceledError.
+    QNetworkReply * Get(QNetworkRequest request);
+    QNetworkReply * Post(QNetworkRequest request, const QByteArray& data);
+    QNetworkReply * Put(QNetworkRequest request, QHttpMultiPart * multi_part);
+
+    int GetNumInFlight() const {return in_flight.size();}
+    quint64 GetNumRequests() const {return num_requests;}
+    quint64 GetNumFailed() const {return num_failed;}
+    quint64 GetNumTimedOut() const {return num_timed_out;}
+    double GetAverageLatencyMsec() const {return (num_finished > 0) ? (double) total_latency_msec / num_finished : 0.0;}
+    qint64 GetMaxLatencyMsec() const {return max_latency_msec;}
+
+private Q_SLOTS:
+    void RequestFinished();
+
+private:
+    MetaverseClient();
+
+    QNetworkRequest Prepare(QNetworkRequest request);
+    QNetworkReply * Track(QNetworkReply * reply);
+
+    static QThreadStorage<MetaverseClient *> thread_clients;
+
+    QNetworkAccessManager * nam;
+    QElapsedTimer clock;
+    QHash<QNetworkReply *, qint64> in_flight; // reply -> start time on clock
+
+    quint64 num_requests;
+    quint64 num_finished;
+    quint64 num_failed;
+    quint64 num_timed_out;
+    qint64 total_latency_msec;
+    qint64 max_latency_msec;
+};
+
+#endif // METAVERSECLIENT_H
@@ -0,0 +1,300 @@
+#include <cstring>
+#include <algorithm>
+
+#include <openssl/evp.h>
+
+#include "multibufferhmac.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MULTIBUFFERHMAC_HAVE_AVX2
+#endif
+
+namespace {
+    const int BLOCK_SIZE = 64;
+
+    const uint32_t MD5_INIT[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+    const uint32_t MD5_K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+
+    const int MD5_S[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+    };
+
+    // Message word used by each step
+    const int MD5_G[64] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+        5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+        0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9
+    };
+
+    // Only used to key the HMAC, so clarity wins over speed here
+    void MD5CompressScalar(uint32_t state[4], const unsigned char * block)
+    {
+        uint32_t m[16];
+        for (int i = 0; i < 16; i++) {
+            m[i] = (uint32_t) block[i * 4] | ((uint32_t) block[i * 4 + 1] << 8) | ((uint32_t) block[i * 4 + 2] << 16) | ((uint32_t) block[i * 4 + 3] << 24);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        for (int i = 0; i < 64; i++) {
+            uint32_t f;
+            if (i < 16) {
+                f = d ^ (b & (c ^ d));
+            } else if (i < 32) {
+                f = c ^ (d & (b ^ c));
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+            } else {
+                f = c ^ (b | ~d);
+            }
+            uint32_t x = a + f + MD5_K[i] + m[MD5_G[i]];
+            a = d;
+            d = c;
+            c = b;
+            b = b + ((x << MD5_S[i]) | (x >> (32 - MD5_S[i])));
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+
+    // Writes the MD5 padding for a message of total_len bytes whose last rem bytes are in tail.
+    // Returns the number of blocks written to out, 1 or 2.
+    int PadTail(unsigned char * out, const unsigned char * tail, int rem, uint64_t total_len)
+    {
+        const int num_blocks = (rem + 1 + 8 <= BLOCK_SIZE) ? 1 : 2;
+        memset(out, 0, num_blocks * BLOCK_SIZE);
+        if (rem > 0) {
+            memcpy(out, tail, rem);
+        }
+        out[rem] = 0x80;
+
+        const uint64_t bit_len = total_len * 8;
+        for (int i = 0; i < 8; i++) {
+            out[num_blocks * BLOCK_SIZE - 8 + i] = (unsigned char) (bit_len >> (8 * i));
+        }
+        return num_blocks;
+    }
+
+#ifdef MULTIBUFFERHMAC_HAVE_AVX2
+#define MBH_TARGET __attribute__((target("avx2")))
+
+    MBH_TARGET inline __m256i RotateLeft(__m256i x, int s)
+    {
+        return _mm256_or_si256(_mm256_slli_epi32(x, s), _mm256_srli_epi32(x, 32 - s));
+    }
+
+    // Eight rows of eight words become eight words of eight lanes
+    MBH_TARGET inline void Transpose8x8(__m256i r[8])
+    {
+        __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+        __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+        __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+        __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+        __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+        __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+        __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+        __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+        __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+        __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+        __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+        __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+        __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+        __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+        r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+        r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+        r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+        r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+        r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+        r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+        r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+        r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+    }
+
+    // One MD5 block per lane. Lanes with a zero mask keep their state.
+    MBH_TARGET void MD5CompressLanes(__m256i state[4], const unsigned char * const blocks[MultiBufferHMAC::MD5_LANES], __m256i active)
+    {
+        __m256i m[16];
+        for (int half = 0; half < 2; half++) {
+            __m256i rows[8];
+            for (int lane = 0; lane < 8; lane++) {
+                rows[lane] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(blocks[lane] + half * 32));
+            }
+            Transpose8x8(rows);
+            for (int i = 0; i < 8; i++) {
+                m[half * 8 + i] = rows[i];
+            }
+        }
+
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        const __m256i ones = _mm256_set1_epi32(-1);
+        for (int i = 0; i < 64; i++) {
+            __m256i f;
+            if (i < 16) {
+                f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+            } else if (i < 32) {
+                f = _mm256_xor_si256(c, _mm256_and_si256(d, _mm256_xor_si256(b, c)));
+            } else if (i < 48) {
+                f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+            } else {
+                f = _mm256_xor_si256(c, _mm256_or_si256(b, _mm256_xor_si256(d, ones)));
+            }
+            __m256i x = _mm256_add_epi32(_mm256_add_epi32(a, f), _mm256_add_epi32(_mm256_set1_epi32((int) MD5_K[i]), m[MD5_G[i]]));
+            a = d;
+            d = c;
+            c = b;
+            b = _mm256_add_epi32(b, RotateLeft(x, MD5_S[i]));
+        }
+
+        state[0] = _mm256_blendv_epi8(state[0], _mm256_add_epi32(state[0], a), active);
+        state[1] = _mm256_blendv_epi8(state[1], _mm256_add_epi32(state[1], b), active);
+        state[2] = _mm256_blendv_epi8(state[2], _mm256_add_epi32(state[2], c), active);
+        state[3] = _mm256_blendv_epi8(state[3], _mm256_add_epi32(state[3], d), active);
+    }
+
+    MBH_TARGET void HMACMD5Lanes(const MultiBufferHMAC::MD5KeyState& key, const unsigned char * const * data, const int * data_lens, int count,
+                                 unsigned char (* digests)[MultiBufferHMAC::MD5_DIGEST_SIZE])
+    {
+        using MultiBufferHMAC::MD5_LANES;
+
+        // The last, partial block of each message plus padding. Lanes past count hash an empty message and are dropped.
+        alignas(32) unsigned char tails[MD5_LANES][2 * BLOCK_SIZE];
+        int full_blocks[MD5_LANES];
+        int total_blocks[MD5_LANES];
+        int max_blocks = 0;
+        for (int lane = 0; lane < MD5_LANES; lane++) {
+            const int len = (lane < count) ? data_lens[lane] : 0;
+            const unsigned char * message = (lane < count) ? data[lane] : nullptr;
+            full_blocks[lane] = len / BLOCK_SIZE;
+            const int rem = len - full_blocks[lane] * BLOCK_SIZE;
+            // The key XOR ipad block comes first, so the hashed length includes it
+            total_blocks[lane] = full_blocks[lane] + PadTail(tails[lane], message + full_blocks[lane] * BLOCK_SIZE, rem, (uint64_t) BLOCK_SIZE + len);
+            max_blocks = std::max(max_blocks, total_blocks[lane]);
+        }
+
+        __m256i state[4];
+        for (int i = 0; i < 4; i++) {
+            state[i] = _mm256_set1_epi32((int) key.inner[i]);
+        }
+
+        for (int block = 0; block < max_blocks; block++) {
+            const unsigned char * blocks[MD5_LANES];
+            alignas(32) int active[MD5_LANES];
+            for (int lane = 0; lane < MD5_LANES; lane++) {
+                if (block < full_blocks[lane]) {
+                    blocks[lane] = data[lane] + block * BLOCK_SIZE;
+                } else if (block < total_blocks[lane]) {
+                    blocks[lane] = tails[lane] + (block - full_blocks[lane]) * BLOCK_SIZE;
+                } else {
+                    blocks[lane] = tails[lane];
+                }
+                active[lane] = (block < total_blocks[lane]) ? -1 : 0;
+            }
+            MD5CompressLanes(state, blocks, _mm256_load_si256(reinterpret_cast<const __m256i *>(active)));
+        }
+
+        // Outer hash: opad state plus one block holding the inner digest, the same length in every lane
+        alignas(32) uint32_t inner_words[4][MD5_LANES];
+        for (int i = 0; i < 4; i++) {
+            _mm256_store_si256(reinterpret_cast<__m256i *>(inner_words[i]), state[i]);
+        }
+
+        alignas(32) unsigned char outer_blocks[MD5_LANES][BLOCK_SIZE];
+        const unsigned char * blocks[MD5_LANES];
+        for (int lane = 0; lane < MD5_LANES; lane++) {
+            unsigned char inner_digest[MultiBufferHMAC::MD5_DIGEST_SIZE];
+            for (int i = 0; i < 4; i++) {
+                memcpy(inner_digest + i * 4, &inner_words[i][lane], 4);
+            }
+            PadTail(outer_blocks[lane], inner_digest, MultiBufferHMAC::MD5_DIGEST_SIZE, (uint64_t) BLOCK_SIZE + MultiBufferHMAC::MD5_DIGEST_SIZE);
+            blocks[lane] = outer_blocks[lane];
+        }
+
+        for (int i = 0; i < 4; i++) {
+            state[i] = _mm256_set1_epi32((int) key.outer[i]);
+        }
+        MD5CompressLanes(state, blocks, _mm256_set1_epi32(-1));
+
+        alignas(32) uint32_t outer_words[4][MD5_LANES];
+        for (int i = 0; i < 4; i++) {
+            _mm256_store_si256(reinterpret_cast<__m256i *>(outer_words[i]), state[i]);
+        }
+        for (int lane = 0; lane < count; lane++) {
+            for (int i = 0; i < 4; i++) {
+                memcpy(digests[lane] + i * 4, &outer_words[i][lane], 4);
+            }
+        }
+    }
+#endif
+}
+
+bool MultiBufferHMAC::IsAvailable()
+{
+#ifdef MULTIBUFFERHMAC_HAVE_AVX2
+    // The lanes store words as they are in memory, which is MD5's little endian order on x86
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+void MultiBufferHMAC::PrepareMD5Key(const unsigned char * key, int key_len, MD5KeyState& state)
+{
+    unsigned char block_key[BLOCK_SIZE] = {0};
+    if (key_len > BLOCK_SIZE) {
+        unsigned int digest_len = 0;
+        EVP_Digest(key, key_len, block_key, &digest_len, EVP_md5(), nullptr);
+    }
+    else if (key_len > 0) {
+        // An empty key may come with a null pointer, which memcpy must not be given even for 0 bytes
+        memcpy(block_key, key, key_len);
+    }
+
+    unsigned char pad[BLOCK_SIZE];
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        pad[i] = block_key[i] ^ 0x36;
+    }
+    memcpy(state.inner, MD5_INIT, sizeof(state.inner));
+    MD5CompressScalar(state.inner, pad);
+
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        pad[i] = block_key[i] ^ 0x5c;
+    }
+    memcpy(state.outer, MD5_INIT, sizeof(state.outer));
+    MD5CompressScalar(state.outer, pad);
+}
+
+void MultiBufferHMAC::HMACMD5(const MD5KeyState& state, const unsigned char * const * data, const int * data_lens, int count,
+                              unsigned char (* digests)[MD5_DIGEST_SIZE])
+{
+#ifdef MULTIBUFFERHMAC_HAVE_AVX2
+    HMACMD5Lanes(state, data, data_lens, std::min(count, (int) MD5_LANES), digests);
+#else
+    Q_UNUSED(state);
+    Q_UNUSED(data);
+    Q_UNUSED(data_lens);
+    Q_UNUSED(count);
+    Q_UNUSED(digests);
+#endif
+}
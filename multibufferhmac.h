@@ -0,0 +1,29 @@
+#ifndef MULTIBUFFERHMAC_H
+#define MULTIBUFFERHMAC_H
+
+#include <stdint.h>
+#include <QtGlobal>
+
+// HMAC-MD5 over several independent buffers at once, one buffer per 32 bit lane of an AVX2 register.
+// Buffers of different lengths share the pass; a lane that has run out of blocks is masked off.
+// Only built for x86 with GCC or Clang. Callers check IsAvailable() and otherwise hash one at a time.
+namespace MultiBufferHMAC {
+    const int MD5_LANES = 8;
+    const int MD5_DIGEST_SIZE = 16;
+
+    // MD5 state after the key XOR ipad / opad block, the only part of HMAC that depends on the key alone
+    struct MD5KeyState {
+        uint32_t inner[4];
+        uint32_t outer[4];
+    };
+
+    bool IsAvailable();
+
+    void PrepareMD5Key(const unsigned char * key, int key_len, MD5KeyState& state);
+
+    // Hashes count buffers, at most MD5_LANES, writing MD5_DIGEST_SIZE bytes per buffer into digests
+    void HMACMD5(const MD5KeyState& state, const unsigned char * const * data, const int * data_lens, int count,
+                 unsigned char (* digests)[MD5_DIGEST_SIZE]);
+}
+
+#endif // MULTIBUFFERHMAC_H
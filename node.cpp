@@ -2,10 +2,17 @@
 
 #include "node.h"
 
-Node::Node()
+Node::Node() :
+    public_ipv4(0),
+    local_ipv4(0),
+    public_port(0),
+    local_port(0),
+    session_local_id(0),
+    domain_session_local_id(0),
+    node_type(NodeType::Unassigned),
+    is_replicated(false)
 {
-    authenticate_hash = nullptr;
-    num_requests = 0;
+
 }
 
 Node::~Node()
@@ -25,13 +32,13 @@ void Node::SetNodeType(NodeType_t n)
 
 void Node::SetPublicAddress(QHostAddress a, quint16 p)
 {
-    public_address = a;
+    public_ipv4 = a.toIPv4Address();
     public_port = p;
 }
 
 void Node::SetLocalAddress(QHostAddress a, quint16 p)
 {
-    local_address = a;
+    local_ipv4 = a.toIPv4Address();
     local_port = p;
 }
 
@@ -56,12 +63,19 @@ void Node::SetConnectionSecret(QUuid c)
         return;
     }
 
+    connection_secret = c;
+    if (authenticate_hash) {
+        authenticate_hash->SetKey(c);
+    }
+}
+
+HMACAuth * Node::GetAuthenticateHash()
+{
     if (!authenticate_hash) {
         authenticate_hash.reset(new HMACAuth());
+        authenticate_hash->SetKey(connection_secret);
     }
-
-    connection_secret = c;
-    authenticate_hash->SetKey(c);
+    return authenticate_hash.get();
 }
 
 void Node::SetPermissions(Permissions p)
@@ -71,13 +85,13 @@ void Node::SetPermissions(Permissions p)
 
 bool Node::CheckNodeAddress(QHostAddress a, quint16 p)
 {
-    //qDebug() << a.toIPv4Address()<< public_address.toIPv4Address() << p << public_port;
-    return (a.toIPv4Address() == public_address.toIPv4Address() && p == public_port);
+    //qDebug() << a.toIPv4Address()<< public_ipv4 << p << public_port;
+    return (a.toIPv4Address() == public_ipv4 && p == public_port);
 }
 
 QHostAddress Node::GetPublicAddress()
 {
-    return public_address;
+    return QHostAddress(public_ipv4);
 }
 
 quint16 Node::GetPublicPort()
@@ -87,7 +101,7 @@ quint16 Node::GetPublicPort()
 
 QHostAddress Node::GetLocalAddress()
 {
-    return local_address;
+    return QHostAddress(local_ipv4);
 }
 
 quint16 Node::GetLocalPort()
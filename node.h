@@ -52,10 +52,10 @@ enum class Permission {
 };
 Q_DECLARE_FLAGS(Permissions, Permission)
 
-class Node : public QObject
+// One assignment client the connection talks to. Plain data, the connection owns it.
+// Addresses are IPv4 only, like everything else the relay routes, so they are kept unboxed.
+class Node
 {
-    Q_OBJECT
-
 public:
     Node();
     ~Node();
@@ -79,25 +79,25 @@ public:
 
     bool CheckNodeAddress(QHostAddress a, quint16 p);
 
+    // Keyed with the connection secret on first use, most nodes never need it
+    HMACAuth * GetAuthenticateHash();
+
+    size_t GetMemoryFootprint() const {return sizeof(Node) + (authenticate_hash ? sizeof(HMACAuth) : 0);}
+
 private:
     QUuid node_id;
-    NodeType_t node_type;
-    QHostAddress public_address;
+    QUuid connection_secret;
+    std::unique_ptr<HMACAuth> authenticate_hash;
+
+    quint32 public_ipv4;
+    quint32 local_ipv4;
     quint16 public_port;
-    QHostAddress local_address;
     quint16 local_port;
     quint16 session_local_id;
-    bool is_replicated;
-    QUuid connection_secret;
-    Permissions permissions;
-
     quint16 domain_session_local_id;
-
-    std::unique_ptr<HMACAuth> authenticate_hash;
-
-    QTimer * hifi_response_timer;
-
-    int num_requests;
+    Permissions permissions;
+    NodeType_t node_type;
+    bool is_replicated;
 };
 
 #endif // NODE_H
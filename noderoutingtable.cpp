@@ -0,0 +1,105 @@
+#include <cstring>
+
+#include "noderoutingtable.h"
+
+NodeRoutingTable::NodeRoutingTable()
+{
+    Clear();
+}
+
+void NodeRoutingTable::SetRoute(NodeType_t node_type, quint32 ipv4, quint16 port)
+{
+    const quint64 key = PackAddress(ipv4, port);
+    if (key == 0) {
+        qDebug() << "NodeRoutingTable::SetRoute() - No address for node type" << (char) node_type;
+        RemoveRoute(node_type);
+        return;
+    }
+
+    if (route_keys[node_type].loadAcquire() == 0) {
+        if (num_routes == MAX_ROUTES) {
+            qDebug() << "NodeRoutingTable::SetRoute() - Route table full, dropping route for node type" << (char) node_type;
+            return;
+        }
+        ++num_routes;
+    }
+
+    // The whole route is one word, so a forwarding thread never sees a half written address
+    route_keys[node_type].storeRelease(key);
+
+    RebuildLookup();
+}
+
+void NodeRoutingTable::RemoveRoute(NodeType_t node_type)
+{
+    if (route_keys[node_type].loadAcquire() == 0) {
+        return;
+    }
+
+    route_keys[node_type].storeRelease(0);
+    --num_routes;
+
+    RebuildLookup();
+}
+
+void NodeRoutingTable::Clear()
+{
+    for (int i = 0; i < 256; i++) {
+        route_keys[i].storeRelease(0);
+    }
+    num_routes = 0;
+
+    memset(lookup, 0, sizeof(lookup));
+}
+
+NodeType_t NodeRoutingTable::GetNodeTypeFromAddress(quint32 ipv4, quint16 port, NodeType_t fallback) const
+{
+    const quint64 key = PackAddress(ipv4, port);
+    if (key == 0) {
+        return fallback;
+    }
+
+    for (int i = HashAddress(key); ; i = (i + 1) & (LOOKUP_SIZE - 1)) {
+        const LookupEntry& entry = lookup[i];
+        if (entry.key == key) {
+            return entry.node_type;
+        }
+        if (entry.key == 0) {
+            return fallback;
+        }
+    }
+}
+
+void NodeRoutingTable::RebuildLookup()
+{
+    // Routes only change when the domain list arrives, so rebuilding keeps removal trivial
+    memset(lookup, 0, sizeof(lookup));
+
+    for (int node_type = 0; node_type < 256; node_type++) {
+        const quint64 key = route_keys[node_type].loadAcquire();
+        if (key == 0) {
+            continue;
+        }
+
+        for (int i = HashAddress(key); ; i = (i + 1) & (LOOKUP_SIZE - 1)) {
+            if (lookup[i].key == key) {
+                // Two node types behind the same address, the first registered keeps it
+                break;
+            }
+            if (lookup[i].key == 0) {
+                lookup[i].key = key;
+                lookup[i].node_type = (NodeType_t) node_type;
+                break;
+            }
+        }
+    }
+}
+
+void NodeRoutingTable::FillRoute(NodeType_t node_type, quint64 key, NodeRoute& route)
+{
+    memset(&route.address, 0, sizeof(route.address));
+    route.address.sin_family = AF_INET;
+    route.address.sin_addr.s_addr = htonl((quint32) (key >> 16));
+    route.address.sin_port = htons((quint16) key);
+    route.node_type = node_type;
+}
@@ -0,0 +1,78 @@
+#ifndef NODEROUTINGTABLE_H
+#define NODEROUTINGTABLE_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#include <WS2tcpip.h>
+#endif //Q_OS_WIN
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif //Q_OS_UNIX
+
+#include "node.h"
+
+// Destination of one node, kept as a ready to use sockaddr so forwarding can call sendto directly
+struct NodeRoute
+{
+    sockaddr_in address;
+    NodeType_t node_type;
+};
+
+// Per-connection routing between node types and server addresses.
+// Client -> server lookups index a 256 entry table by NodeType_t, server -> client lookups
+// go through a small open addressed hash keyed by the packed (ipv4, port) of the sender.
+// Both lookups are constant time and do not allocate.
+// Routes are written on the connection thread. GetRoute is also called from the data channel thread,
+// so each route is published as one atomic packed address; everything else is connection thread only.
+class NodeRoutingTable
+{
+public:
+    NodeRoutingTable();
+
+    void SetRoute(NodeType_t node_type, quint32 ipv4, quint16 port);
+    void RemoveRoute(NodeType_t node_type);
+    void Clear();
+
+    // Safe from any thread, a route that is being replaced or removed is seen either before or after the change
+    bool GetRoute(NodeType_t node_type, NodeRoute& route) const {
+        const quint64 key = route_keys[node_type].loadAcquire();
+        if (key == 0) {
+            return false;
+        }
+        FillRoute(node_type, key, route);
+        return true;
+    }
+
+    NodeType_t GetNodeTypeFromAddress(quint32 ipv4, quint16 port, NodeType_t fallback) const;
+
+    int GetNumRoutes() const {return num_routes;}
+
+private:
+    static const int MAX_ROUTES = 16;
+    static const int LOOKUP_SIZE = 2 * MAX_ROUTES; // power of two, never more than half full
+
+    struct LookupEntry
+    {
+        quint64 key; // 0 marks an empty entry, no node is ever reachable at 0.0.0.0:0
+        NodeType_t node_type;
+    };
+
+    static quint64 PackAddress(quint32 ipv4, quint16 port) {return ((quint64) ipv4 << 16) | port;}
+    static int HashAddress(quint64 key) {return (int) ((key * 0x9E3779B97F4A7C15ULL) >> 59) & (LOOKUP_SIZE - 1);}
+
+    static void FillRoute(NodeType_t node_type, quint64 key, NodeRoute& route);
+
+    void RebuildLookup();
+
+    QAtomicInteger<quint64> route_keys[256]; // packed address per node type, 0 when there is no route
+    int num_routes;
+
+    LookupEntry lookup[LOOKUP_SIZE];
+};
+
+#endif // NODEROUTINGTABLE_H
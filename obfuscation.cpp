@@ -0,0 +1,93 @@
+#include <cstring>
+
+#include "obfuscation.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OBFUSCATION_HAVE_SSE2
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define OBFUSCATION_HAVE_AVX2
+#endif
+
+namespace {
+    // Handles whatever is left after the wide loops, size is a multiple of nothing in particular
+    void XorWords(char * data, int size, uint64_t key)
+    {
+        int i = 0;
+        for (; i + (int) sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            word ^= key;
+            memcpy(data + i, &word, sizeof(word));
+        }
+
+        const char * key_bytes = reinterpret_cast<const char *>(&key);
+        for (int j = 0; i < size; ++i, ++j) {
+            data[i] ^= key_bytes[j];
+        }
+    }
+
+#ifdef OBFUSCATION_HAVE_SSE2
+    int XorSSE2(char * data, int size, uint64_t key)
+    {
+        const __m128i key128 = _mm_set1_epi64x((long long) key);
+        int i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), _mm_xor_si128(block, key128));
+        }
+        return i;
+    }
+#endif
+
+#ifdef OBFUSCATION_HAVE_AVX2
+    __attribute__((target("avx2")))
+    int XorAVX2(char * data, int size, uint64_t key)
+    {
+        const __m256i key256 = _mm256_set1_epi64x((long long) key);
+        int i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i), _mm256_xor_si256(block, key256));
+        }
+        return i;
+    }
+
+    bool HasAVX2()
+    {
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        return has_avx2;
+    }
+#endif
+}
+
+void Obfuscation::XorInPlace(char * data, int size, uint64_t key)
+{
+    // Every wide block is a whole number of keys long, so the key stays in phase from one loop to the next
+    int done = 0;
+#ifdef OBFUSCATION_HAVE_AVX2
+    if (HasAVX2()) {
+        done = XorAVX2(data, size, key);
+    }
+#endif
+#ifdef OBFUSCATION_HAVE_SSE2
+    done += XorSSE2(data + done, size - done, key);
+#endif
+    XorWords(data + done, size - done, key);
+}
+
+uint64_t Obfuscation::RotateKey(uint64_t key, int phase)
+{
+    const char * key_bytes = reinterpret_cast<const char *>(&key);
+    char rotated[sizeof(uint64_t)];
+    for (int i = 0; i < (int) sizeof(uint64_t); i++) {
+        rotated[i] = key_bytes[(phase + i) % sizeof(uint64_t)];
+    }
+
+    uint64_t rotated_key;
+    memcpy(&rotated_key, rotated, sizeof(rotated_key));
+    return rotated_key;
+}
@@ -0,0 +1,16 @@
+#ifndef OBFUSCATION_H
+#define OBFUSCATION_H
+
+#include <stdint.h>
+
+// XOR kernel behind packet obfuscation. The 8 byte key repeats from data[0] onward, in the byte order
+// the key has in memory, which is what the byte-at-a-time loop it replaces did.
+namespace Obfuscation {
+    // Picks SSE2 or AVX2 when the CPU has them, otherwise works a 64 bit word at a time
+    void XorInPlace(char * data, int size, uint64_t key);
+
+    // Key for data that starts phase bytes into the repeating pattern
+    uint64_t RotateKey(uint64_t key, int phase);
+}
+
+#endif // OBFUSCATION_H
@@ -1,83 +1,5 @@
 #include "packet.h"
-
-PacketVersion VersionForPacketType(PacketType packetType) {
-    switch (packetType) {
-    case PacketType::StunResponse:
-        return 17;
-    case PacketType::DomainList:
-        return static_cast<PacketVersion>(DomainListVersion::AuthenticationOptional);
-    case PacketType::EntityAdd:
-    case PacketType::EntityClone:
-    case PacketType::EntityEdit:
-    case PacketType::EntityData:
-    case PacketType::EntityPhysics:
-        return static_cast<PacketVersion>(EntityVersion::FixedLightSerialization);
-    case PacketType::EntityQuery:
-        return static_cast<PacketVersion>(EntityQueryPacketVersion::ConicalFrustums);
-    case PacketType::AvatarIdentity:
-    case PacketType::AvatarData:
-    case PacketType::BulkAvatarData:
-    case PacketType::KillAvatar:
-        return static_cast<PacketVersion>(AvatarMixerPacketVersion::JointTransScaled);
-    case PacketType::MessagesData:
-        return static_cast<PacketVersion>(MessageDataVersion::TextOrBinaryData);
-    // ICE packets
-    case PacketType::ICEServerPeerInformation:
-        return 17;
-    case PacketType::ICEServerHeartbeatACK:
-        return 17;
-    case PacketType::ICEServerQuery:
-        return 17;
-    case PacketType::ICEServerHeartbeat:
-        return 18; // ICE Server Heartbeat signing
-    case PacketType::ICEPing:
-        return static_cast<PacketVersion>(IcePingVersion::SendICEPeerID);
-    case PacketType::ICEPingReply:
-        return 17;
-    case PacketType::ICEServerHeartbeatDenied:
-        return 17;
-    case PacketType::AssetMappingOperation:
-    case PacketType::AssetMappingOperationReply:
-    case PacketType::AssetGetInfo:
-    case PacketType::AssetGet:
-    case PacketType::AssetUpload:
-        return static_cast<PacketVersion>(AssetServerPacketVersion::BakingTextureMeta);
-    case PacketType::NodeIgnoreRequest:
-        return 18; // Introduction of node ignore request (which replaced an unused packet tpye)
-
-    case PacketType::DomainConnectionDenied:
-        return static_cast<PacketVersion>(DomainConnectionDeniedVersion::IncludesExtraInfo);
-
-    case PacketType::DomainConnectRequest:
-        return static_cast<PacketVersion>(DomainConnectRequestVersion::AlwaysHasMachineFingerprint);
-
-    case PacketType::DomainServerAddedNode:
-        return static_cast<PacketVersion>(DomainServerAddedNodeVersion::PermissionsGrid);
-
-    case PacketType::EntityScriptCallMethod:
-        return static_cast<PacketVersion>(EntityScriptCallMethodVersion::ClientCallable);
-
-    case PacketType::MixedAudio:
-    case PacketType::SilentAudioFrame:
-    case PacketType::InjectAudio:
-    case PacketType::MicrophoneAudioNoEcho:
-    case PacketType::MicrophoneAudioWithEcho:
-    case PacketType::AudioStreamStats:
-        return static_cast<PacketVersion>(AudioVersion::HighDynamicRangeVolume);
-    case PacketType::DomainSettings:
-        return 18;  // replace min_avatar_scale and max_avatar_scale with min_avatar_height and max_avatar_height
-    case PacketType::Ping:
-        return static_cast<PacketVersion>(PingVersion::IncludeConnectionID);
-    case PacketType::AvatarQuery:
-        return static_cast<PacketVersion>(AvatarQueryVersion::ConicalFrustums);
-    case PacketType::AvatarIdentityRequest:
-        return 22;
-    case PacketType::EntityQueryInitialResultsComplete:
-        return static_cast<PacketVersion>(EntityVersion::ParticleSpin);
-    default:
-        return 22;
-    }
-}
+#include "obfuscation.h"
 
 uint qHash(const PacketType& key, uint seed) {
     // seems odd that Qt couldn't figure out this cast itself, but this fixes a compile error after switch
@@ -138,7 +60,7 @@ Packet::Packet(uint32_t sequence, ControlType t, qint64 size){
     //write(reinterpret_cast<const char*>(&sequence_number), sizeof(uint32_t));
 }
 
-Packet::Packet(char * data, qint64 size)
+Packet::Packet(const char * data, qint64 size)
 {
     packet_size = size;
 
@@ -202,10 +124,7 @@ int Packet::HeaderSize(bool is_part_of_message) {
 }
 
 int Packet::LocalHeaderSize(PacketType type) {
-    bool non_sourced = PacketTypeEnum::GetNonSourcedPackets().contains(type);
-    bool non_verified = PacketTypeEnum::GetNonVerifiedPackets().contains(type);
-    qint64 optional_size = (non_sourced ? 0 : 2) + ((non_sourced || non_verified) ? 0 : 16);
-    return sizeof(PacketType) + sizeof(PacketVersion) + optional_size;
+    return PacketTypeInfo::GetLocalHeaderSize(type);
 }
 
 int Packet::LocalControlHeaderSize() {
@@ -225,7 +144,7 @@ std::unique_ptr<Packet> Packet::Create(uint32_t sequence, PacketType t, qint64 s
     return packet;
 }
 
-std::unique_ptr<Packet> Packet::FromReceivedPacket(char * data, qint64 size)
+std::unique_ptr<Packet> Packet::FromReceivedPacket(const char * data, qint64 size)
 {
     // allocate memory
     auto packet = std::unique_ptr<Packet>(new Packet(data, size));
@@ -241,7 +160,7 @@ std::unique_ptr<Packet> Packet::CreateControl(uint32_t sequence, ControlType t,
     return std::unique_ptr<Packet>(new Packet(sequence, t, Packet::LocalControlHeaderSize() + size));
 }
 
-std::unique_ptr<Packet> Packet::FromReceivedControlPacket(char * data, qint64 size)
+std::unique_ptr<Packet> Packet::FromReceivedControlPacket(const char * data, qint64 size)
 {
     // allocate memory
     auto packet = std::unique_ptr<Packet>(new Packet(data, Packet::LocalControlHeaderSize() + size));
@@ -305,17 +224,12 @@ qint64 Packet::readData(char* dest, qint64 max_size) {
 }
 
 void Packet::Obfuscate(ObfuscationLevel level) {
-    QList<uint64_t> KEYS = QList<uint64_t>() << 0x0 << 0x6362726973736574 << 0x7362697261726461 << 0x72687566666d616e;
-    auto obfuscation_key = KEYS[obfuscation_level] ^ KEYS[level]; // Undo old and apply new one.
+    auto obfuscation_key = OBFUSCATION_KEYS[obfuscation_level] ^ OBFUSCATION_KEYS[level]; // Undo old and apply new one.
     if (obfuscation_key != 0) {
 
         int size = GetDataSize() - HeaderSize(is_part_of_message);
         char * current = GetData() + HeaderSize(is_part_of_message);
-        auto xor_value = reinterpret_cast<const char*>(&obfuscation_key);
-
-        for (int i = 0; i < size; ++i) {
-            *(current++) ^= *(xor_value + (i % sizeof(uint64_t)));
-        }
+        Obfuscation::XorInPlace(current, size, obfuscation_key);
 
         // Update members and header
         obfuscation_level = level;
@@ -365,7 +279,7 @@ void Packet::ReadControlType() {
 
 void Packet::WriteSourceID(quint16 s)
 {
-    if (PacketTypeEnum::GetNonSourcedPackets().contains(type)) return;
+    if (!PacketTypeInfo::IsSourced(type)) return;
 
     auto offset = Packet::HeaderSize(false) + sizeof(PacketType) + sizeof(PacketVersion);
 
@@ -375,9 +289,13 @@ void Packet::WriteSourceID(quint16 s)
     //qDebug() << "source id"  << source_id;
 }
 
-QByteArray Packet::HashForPacketAndHMAC(const Packet& packet, HMACAuth * hash) {
-    int offset = Packet::HeaderSize(packet.GetIsPartOfMessage()) + sizeof(PacketType) + sizeof(PacketVersion)
+int Packet::HashedDataOffset(const Packet& packet) {
+    return Packet::HeaderSize(packet.GetIsPartOfMessage()) + sizeof(PacketType) + sizeof(PacketVersion)
         + 2 + 16;
+}
+
+QByteArray Packet::HashForPacketAndHMAC(const Packet& packet, HMACAuth * hash) {
+    int offset = HashedDataOffset(packet);
 
     // add the packet payload and the connection UUID
     HMACAuth::HMACHash hash_result;
@@ -387,9 +305,32 @@ QByteArray Packet::HashForPacketAndHMAC(const Packet& packet, HMACAuth * hash) {
     return QByteArray((const char*) hash_result.data(), (int) hash_result.size());
 }
 
+QList<QByteArray> Packet::HashForPacketsAndHMAC(const QList<const Packet *>& packets, HMACAuth * hash) {
+    const int count = packets.size();
+    std::vector<const char *> data(count);
+    std::vector<int> data_lens(count);
+    for (int i = 0; i < count; i++) {
+        const int offset = HashedDataOffset(*packets[i]);
+        data[i] = packets[i]->GetData() + offset;
+        data_lens[i] = packets[i]->GetDataSize() - offset;
+    }
+
+    std::vector<HMACAuth::HMACHash> hash_results(count);
+    QList<QByteArray> hashes;
+    if (!hash->CalculateHashes(hash_results.data(), data.data(), data_lens.data(), count)) {
+        return hashes;
+    }
+
+    hashes.reserve(count);
+    for (int i = 0; i < count; i++) {
+        hashes.append(QByteArray((const char*) hash_results[i].data(), (int) hash_results[i].size()));
+    }
+    return hashes;
+}
+
 void Packet::WriteVerificationHash(HMACAuth * h)
 {
-    if (PacketTypeEnum::GetNonSourcedPackets().contains(type) || PacketTypeEnum::GetNonVerifiedPackets().contains(type))
+    if (!PacketTypeInfo::IsVerified(type))
         return;
 
     auto offset = Packet::HeaderSize(false) + sizeof(PacketType) + sizeof(PacketVersion)
@@ -122,87 +122,11 @@ public:
 
         NUM_PACKET_TYPE
     };
-
-    const static QHash<PacketTypeEnum::Value, PacketTypeEnum::Value> GetReplicatedPacketMapping() {
-        const static QHash<PacketTypeEnum::Value, PacketTypeEnum::Value> REPLICATED_PACKET_MAPPING {
-            { PacketTypeEnum::Value::MicrophoneAudioNoEcho, PacketTypeEnum::Value::ReplicatedMicrophoneAudioNoEcho },
-            { PacketTypeEnum::Value::MicrophoneAudioWithEcho, PacketTypeEnum::Value::ReplicatedMicrophoneAudioWithEcho },
-            { PacketTypeEnum::Value::InjectAudio, PacketTypeEnum::Value::ReplicatedInjectAudio },
-            { PacketTypeEnum::Value::SilentAudioFrame, PacketTypeEnum::Value::ReplicatedSilentAudioFrame },
-            { PacketTypeEnum::Value::AvatarIdentity, PacketTypeEnum::Value::ReplicatedAvatarIdentity },
-            { PacketTypeEnum::Value::KillAvatar, PacketTypeEnum::Value::ReplicatedKillAvatar },
-            { PacketTypeEnum::Value::BulkAvatarData, PacketTypeEnum::Value::ReplicatedBulkAvatarData }
-        };
-        return REPLICATED_PACKET_MAPPING;
-    }
-
-    const static QSet<PacketTypeEnum::Value> GetProxiedPackets() {
-        const static QSet<PacketTypeEnum::Value> PROXIED_PACKETS = QSet<PacketTypeEnum::Value>()
-            << PacketTypeEnum::Value::ProxiedICEPing
-            << PacketTypeEnum::Value::ProxiedICEPingReply
-            << PacketTypeEnum::Value::ProxiedDomainListRequest;
-        return PROXIED_PACKETS;
-    }
-
-    const static QSet<PacketTypeEnum::Value> GetNonVerifiedPackets() {
-        const static QSet<PacketTypeEnum::Value> NON_VERIFIED_PACKETS = QSet<PacketTypeEnum::Value>()
-            << PacketTypeEnum::Value::NodeJsonStats
-            << PacketTypeEnum::Value::EntityQuery
-            << PacketTypeEnum::Value::OctreeDataNack
-            << PacketTypeEnum::Value::EntityEditNack
-            << PacketTypeEnum::Value::DomainListRequest
-            << PacketTypeEnum::Value::StopNode
-            << PacketTypeEnum::Value::DomainDisconnectRequest
-            << PacketTypeEnum::Value::UsernameFromIDRequest
-            << PacketTypeEnum::Value::NodeKickRequest
-            << PacketTypeEnum::Value::NodeMuteRequest;
-        return NON_VERIFIED_PACKETS;
-    }
-
-    const static QSet<PacketTypeEnum::Value> GetNonSourcedPackets() {
-        const static QSet<PacketTypeEnum::Value> NON_SOURCED_PACKETS = QSet<PacketTypeEnum::Value>()
-            << PacketTypeEnum::Value::StunResponse << PacketTypeEnum::Value::CreateAssignment
-            << PacketTypeEnum::Value::RequestAssignment << PacketTypeEnum::Value::DomainServerRequireDTLS
-            << PacketTypeEnum::Value::DomainConnectRequest << PacketTypeEnum::Value::DomainList
-            << PacketTypeEnum::Value::DomainConnectionDenied << PacketTypeEnum::Value::DomainServerPathQuery
-            << PacketTypeEnum::Value::DomainServerPathResponse << PacketTypeEnum::Value::DomainServerAddedNode
-            << PacketTypeEnum::Value::DomainServerConnectionToken << PacketTypeEnum::Value::DomainSettingsRequest
-            << PacketTypeEnum::Value::OctreeDataFileRequest << PacketTypeEnum::Value::OctreeDataFileReply
-            << PacketTypeEnum::Value::OctreeDataPersist << PacketTypeEnum::Value::DomainContentReplacementFromUrl
-            << PacketTypeEnum::Value::DomainSettings << PacketTypeEnum::Value::ICEServerPeerInformation
-            << PacketTypeEnum::Value::ICEServerQuery << PacketTypeEnum::Value::ICEServerHeartbeat
-            << PacketTypeEnum::Value::ICEServerHeartbeatACK << PacketTypeEnum::Value::ICEPing
-            << PacketTypeEnum::Value::ICEPingReply << PacketTypeEnum::Value::ICEServerHeartbeatDenied
-            << PacketTypeEnum::Value::AssignmentClientStatus << PacketTypeEnum::Value::StopNode
-            << PacketTypeEnum::Value::DomainServerRemovedNode << PacketTypeEnum::Value::UsernameFromIDReply
-            << PacketTypeEnum::Value::OctreeFileReplacement << PacketTypeEnum::Value::ReplicatedMicrophoneAudioNoEcho
-            << PacketTypeEnum::Value::ReplicatedMicrophoneAudioWithEcho << PacketTypeEnum::Value::ReplicatedInjectAudio
-            << PacketTypeEnum::Value::ReplicatedSilentAudioFrame << PacketTypeEnum::Value::ReplicatedAvatarIdentity
-            << PacketTypeEnum::Value::ReplicatedKillAvatar << PacketTypeEnum::Value::ReplicatedBulkAvatarData;
-        return NON_SOURCED_PACKETS;
-    }
-
-    const static QSet<PacketTypeEnum::Value> GetDomainSourcedPackets() {
-        const static QSet<PacketTypeEnum::Value> DOMAIN_SOURCED_PACKETS = QSet<PacketTypeEnum::Value>()
-            << PacketTypeEnum::Value::AssetMappingOperation
-            << PacketTypeEnum::Value::AssetGet
-            << PacketTypeEnum::Value::AssetUpload;
-        return DOMAIN_SOURCED_PACKETS;
-    }
-
-    const static QSet<PacketTypeEnum::Value> GetDomainIgnoredVerificationPackets() {
-        const static QSet<PacketTypeEnum::Value> DOMAIN_IGNORED_VERIFICATION_PACKETS = QSet<PacketTypeEnum::Value>()
-            << PacketTypeEnum::Value::AssetMappingOperationReply
-            << PacketTypeEnum::Value::AssetGetReply
-            << PacketTypeEnum::Value::AssetUploadReply;
-        return DOMAIN_IGNORED_VERIFICATION_PACKETS;
-    }
 };
 
 using PacketType = PacketTypeEnum::Value;
 typedef char PacketVersion;
 
-PacketVersion VersionForPacketType(PacketType packetType);
 uint qHash(const PacketType& key, uint seed);
 
 // Due to the different legacy behaviour, we need special processing for domains that were created before
@@ -338,6 +262,200 @@ enum class AvatarQueryVersion : PacketVersion {
     ConicalFrustums = 22
 };
 
+// Everything the relay needs to know about a packet type, resolved at compile time into
+// 256 entry tables indexed by the type's value. ENTRIES is the single source; types not
+// listed are sourced, verified, not replicated and at DEFAULT_VERSION.
+namespace PacketTypeInfo {
+    enum Flags : uint8_t {
+        NonSourced = 0x01,                 // no source ID and no verification hash
+        NonVerified = 0x02,                // source ID but no verification hash
+        DomainSourced = 0x04,
+        DomainIgnoredVerification = 0x08,
+        Proxied = 0x10                     // handled by the relay, never sent to a server as is
+    };
+
+    const PacketVersion DEFAULT_VERSION = 22;
+
+    struct Entry {
+        PacketType type;
+        uint8_t flags;
+        PacketVersion version = 0;                           // 0 keeps DEFAULT_VERSION
+        PacketType replicated_type = PacketType::Unknown;    // Unknown when the type has no replicated form
+    };
+
+    constexpr Entry ENTRIES[] = {
+        { PacketType::StunResponse, NonSourced, 17 },
+        { PacketType::DomainList, NonSourced, static_cast<PacketVersion>(DomainListVersion::AuthenticationOptional) },
+        { PacketType::Ping, 0, static_cast<PacketVersion>(PingVersion::IncludeConnectionID) },
+        { PacketType::KillAvatar, 0, static_cast<PacketVersion>(AvatarMixerPacketVersion::JointTransScaled), PacketType::ReplicatedKillAvatar },
+        { PacketType::AvatarData, 0, static_cast<PacketVersion>(AvatarMixerPacketVersion::JointTransScaled) },
+        { PacketType::InjectAudio, 0, static_cast<PacketVersion>(AudioVersion::HighDynamicRangeVolume), PacketType::ReplicatedInjectAudio },
+        { PacketType::MixedAudio, 0, static_cast<PacketVersion>(AudioVersion::HighDynamicRangeVolume) },
+        { PacketType::MicrophoneAudioNoEcho, 0, static_cast<PacketVersion>(AudioVersion::HighDynamicRangeVolume), PacketType::ReplicatedMicrophoneAudioNoEcho },
+        { PacketType::MicrophoneAudioWithEcho, 0, static_cast<PacketVersion>(AudioVersion::HighDynamicRangeVolume), PacketType::ReplicatedMicrophoneAudioWithEcho },
+        { PacketType::BulkAvatarData, 0, static_cast<PacketVersion>(AvatarMixerPacketVersion::JointTransScaled), PacketType::ReplicatedBulkAvatarData },
+        { PacketType::SilentAudioFrame, 0, static_cast<PacketVersion>(AudioVersion::HighDynamicRangeVolume), PacketType::ReplicatedSilentAudioFrame },
+        { PacketType::DomainListRequest, NonVerified },
+        { PacketType::RequestAssignment, NonSourced },
+        { PacketType::CreateAssignment, NonSourced },
+        { PacketType::DomainConnectionDenied, NonSourced, static_cast<PacketVersion>(DomainConnectionDeniedVersion::IncludesExtraInfo) },
+        { PacketType::AudioStreamStats, 0, static_cast<PacketVersion>(AudioVersion::HighDynamicRangeVolume) },
+        { PacketType::DomainServerPathQuery, NonSourced },
+        { PacketType::DomainServerPathResponse, NonSourced },
+        { PacketType::DomainServerAddedNode, NonSourced, static_cast<PacketVersion>(DomainServerAddedNodeVersion::PermissionsGrid) },
+        { PacketType::ICEServerPeerInformation, NonSourced, 17 },
+        { PacketType::ICEServerQuery, NonSourced, 17 },
+        { PacketType::AvatarIdentityRequest, 0, 22 },
+        { PacketType::AssignmentClientStatus, NonSourced },
+        { PacketType::AvatarIdentity, 0, static_cast<PacketVersion>(AvatarMixerPacketVersion::JointTransScaled), PacketType::ReplicatedAvatarIdentity },
+        { PacketType::NodeIgnoreRequest, 0, 18 }, // Introduction of node ignore request (which replaced an unused packet tpye)
+        { PacketType::DomainConnectRequest, NonSourced, static_cast<PacketVersion>(DomainConnectRequestVersion::AlwaysHasMachineFingerprint) },
+        { PacketType::DomainServerRequireDTLS, NonSourced },
+        { PacketType::NodeJsonStats, NonVerified },
+        { PacketType::OctreeDataNack, NonVerified },
+        { PacketType::StopNode, NonSourced | NonVerified },
+        { PacketType::EntityEditNack, NonVerified },
+        { PacketType::ICEServerHeartbeat, NonSourced, 18 }, // ICE Server Heartbeat signing
+        { PacketType::ICEPing, NonSourced, static_cast<PacketVersion>(IcePingVersion::SendICEPeerID) },
+        { PacketType::ICEPingReply, NonSourced, 17 },
+        { PacketType::EntityData, 0, static_cast<PacketVersion>(EntityVersion::FixedLightSerialization) },
+        { PacketType::EntityQuery, NonVerified, static_cast<PacketVersion>(EntityQueryPacketVersion::ConicalFrustums) },
+        { PacketType::EntityAdd, 0, static_cast<PacketVersion>(EntityVersion::FixedLightSerialization) },
+        { PacketType::EntityEdit, 0, static_cast<PacketVersion>(EntityVersion::FixedLightSerialization) },
+        { PacketType::DomainServerConnectionToken, NonSourced },
+        { PacketType::DomainSettingsRequest, NonSourced },
+        { PacketType::DomainSettings, NonSourced, 18 }, // replace min_avatar_scale and max_avatar_scale with min_avatar_height and max_avatar_height
+        { PacketType::AssetGet, DomainSourced, static_cast<PacketVersion>(AssetServerPacketVersion::BakingTextureMeta) },
+        { PacketType::AssetGetReply, DomainIgnoredVerification },
+        { PacketType::AssetUpload, DomainSourced, static_cast<PacketVersion>(AssetServerPacketVersion::BakingTextureMeta) },
+        { PacketType::AssetUploadReply, DomainIgnoredVerification },
+        { PacketType::AssetGetInfo, 0, static_cast<PacketVersion>(AssetServerPacketVersion::BakingTextureMeta) },
+        { PacketType::DomainDisconnectRequest, NonVerified },
+        { PacketType::DomainServerRemovedNode, NonSourced },
+        { PacketType::MessagesData, 0, static_cast<PacketVersion>(MessageDataVersion::TextOrBinaryData) },
+        { PacketType::ICEServerHeartbeatDenied, NonSourced, 17 },
+        { PacketType::AssetMappingOperation, DomainSourced, static_cast<PacketVersion>(AssetServerPacketVersion::BakingTextureMeta) },
+        { PacketType::AssetMappingOperationReply, DomainIgnoredVerification, static_cast<PacketVersion>(AssetServerPacketVersion::BakingTextureMeta) },
+        { PacketType::ICEServerHeartbeatACK, NonSourced, 17 },
+        { PacketType::NodeKickRequest, NonVerified },
+        { PacketType::NodeMuteRequest, NonVerified },
+        { PacketType::UsernameFromIDRequest, NonVerified },
+        { PacketType::UsernameFromIDReply, NonSourced },
+        { PacketType::AvatarQuery, 0, static_cast<PacketVersion>(AvatarQueryVersion::ConicalFrustums) },
+        { PacketType::EntityPhysics, 0, static_cast<PacketVersion>(EntityVersion::FixedLightSerialization) },
+        { PacketType::OctreeFileReplacement, NonSourced },
+        { PacketType::ReplicatedMicrophoneAudioNoEcho, NonSourced },
+        { PacketType::ReplicatedMicrophoneAudioWithEcho, NonSourced },
+        { PacketType::ReplicatedInjectAudio, NonSourced },
+        { PacketType::ReplicatedSilentAudioFrame, NonSourced },
+        { PacketType::ReplicatedAvatarIdentity, NonSourced },
+        { PacketType::ReplicatedKillAvatar, NonSourced },
+        { PacketType::ReplicatedBulkAvatarData, NonSourced },
+        { PacketType::DomainContentReplacementFromUrl, NonSourced },
+        { PacketType::EntityScriptCallMethod, 0, static_cast<PacketVersion>(EntityScriptCallMethodVersion::ClientCallable) },
+        { PacketType::OctreeDataFileRequest, NonSourced },
+        { PacketType::OctreeDataFileReply, NonSourced },
+        { PacketType::OctreeDataPersist, NonSourced },
+        { PacketType::EntityClone, 0, static_cast<PacketVersion>(EntityVersion::FixedLightSerialization) },
+        { PacketType::EntityQueryInitialResultsComplete, 0, static_cast<PacketVersion>(EntityVersion::ParticleSpin) },
+        { PacketType::ProxiedICEPing, Proxied },
+        { PacketType::ProxiedICEPingReply, Proxied },
+        { PacketType::ProxiedDomainListRequest, Proxied },
+    };
+
+    struct Table {
+        uint8_t flags[256];
+        PacketVersion version[256];
+        PacketType replicated_type[256];
+        uint8_t local_header_size[256];
+    };
+
+    constexpr Table MakeTable() {
+        Table table = {};
+        for (int i = 0; i < 256; i++) {
+            table.version[i] = DEFAULT_VERSION;
+            table.replicated_type[i] = PacketType::Unknown;
+        }
+        for (const Entry& entry : ENTRIES) {
+            const uint8_t i = static_cast<uint8_t>(entry.type);
+            table.flags[i] = entry.flags;
+            if (entry.version != 0) {
+                table.version[i] = entry.version;
+            }
+            table.replicated_type[i] = entry.replicated_type;
+        }
+        for (int i = 0; i < 256; i++) {
+            const bool non_sourced = table.flags[i] & NonSourced;
+            const bool non_verified = table.flags[i] & NonVerified;
+            // type + version, then a 2 byte source ID and a 16 byte verification hash when present
+            table.local_header_size[i] = sizeof(PacketType) + sizeof(PacketVersion) + (non_sourced ? 0 : 2) + ((non_sourced || non_verified) ? 0 : 16);
+        }
+        return table;
+    }
+
+    constexpr Table TABLE = MakeTable();
+
+    constexpr bool HasFlag(PacketType type, uint8_t flag) {return (TABLE.flags[static_cast<uint8_t>(type)] & flag) != 0;}
+    constexpr bool IsSourced(PacketType type) {return !HasFlag(type, NonSourced);}
+    constexpr bool IsVerified(PacketType type) {return !HasFlag(type, NonSourced | NonVerified);}
+    constexpr bool IsDomainSourced(PacketType type) {return HasFlag(type, DomainSourced);}
+    constexpr bool IsDomainIgnoredVerification(PacketType type) {return HasFlag(type, DomainIgnoredVerification);}
+    constexpr bool IsProxied(PacketType type) {return HasFlag(type, Proxied);}
+    constexpr PacketType GetReplicatedType(PacketType type) {return TABLE.replicated_type[static_cast<uint8_t>(type)];}
+    constexpr PacketVersion GetVersion(PacketType type) {return TABLE.version[static_cast<uint8_t>(type)];}
+    constexpr int GetLocalHeaderSize(PacketType type) {return TABLE.local_header_size[static_cast<uint8_t>(type)];}
+
+    constexpr int CountFlag(uint8_t flag) {
+        int count = 0;
+        for (const Entry& entry : ENTRIES) {
+            count += (entry.flags & flag) ? 1 : 0;
+        }
+        return count;
+    }
+
+    constexpr int NUM_PROXIED_PACKETS = CountFlag(Proxied);
+
+    // Consistency checks, so a mistake in ENTRIES fails the build instead of corrupting headers
+    constexpr bool EntriesAreUniqueAndInRange() {
+        for (const Entry& entry : ENTRIES) {
+            if (entry.type >= PacketType::NUM_PACKET_TYPE) {
+                return false;
+            }
+            int count = 0;
+            for (const Entry& other : ENTRIES) {
+                count += (other.type == entry.type) ? 1 : 0;
+            }
+            if (count != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr bool ReplicatedTypesAreConsistent() {
+        for (const Entry& entry : ENTRIES) {
+            const PacketType replicated = entry.replicated_type;
+            if (replicated != PacketType::Unknown && (IsSourced(replicated) || GetReplicatedType(replicated) != PacketType::Unknown)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(static_cast<int>(PacketType::NUM_PACKET_TYPE) <= 256, "PacketType must fit in a uint8_t");
+    static_assert(EntriesAreUniqueAndInRange(), "Every packet type may be listed once in PacketTypeInfo::ENTRIES");
+    static_assert(ReplicatedTypesAreConsistent(), "Replicated packet types must be non-sourced and not replicated again");
+    static_assert(!(HasFlag(PacketType::StopNode, NonSourced) && IsVerified(PacketType::StopNode)), "Non-sourced packets are never verified");
+    static_assert(GetLocalHeaderSize(PacketType::StunResponse) == 2, "Non-sourced packets carry only type and version");
+    static_assert(GetLocalHeaderSize(PacketType::EntityQuery) == 4, "Non-verified packets add the source ID");
+    static_assert(GetLocalHeaderSize(PacketType::AvatarData) == 20, "Verified packets add the source ID and hash");
+    static_assert(NUM_PROXIED_PACKETS == 3, "Proxied packets are left out of the protocol signature");
+}
+
+constexpr PacketVersion VersionForPacketType(PacketType packetType) {
+    return PacketTypeInfo::GetVersion(packetType);
+}
+
 using ControlBitAndType = uint32_t;
 
 enum ControlType : uint16_t {
@@ -384,6 +502,9 @@ const uint32_t MESSAGE_NUMBER_MASK = ~PACKET_POSITION_MASK;
 
 static const uint32_t MESSAGE_PART_NUMBER_MASK = ~uint32_t(0);
 
+// XOR keys indexed by obfuscation level
+constexpr uint64_t OBFUSCATION_KEYS[] = { 0x0, 0x6362726973736574, 0x7362697261726461, 0x72687566666d616e };
+
 class Packet : public QIODevice
 {
 public:
@@ -397,7 +518,7 @@ public:
 
     Packet(uint32_t sequence, PacketType t, qint64 size = MAX_PACKET_SIZE, bool reliable = false, bool part_of_message = false);
     Packet(uint32_t sequence, ControlType t, qint64 size = MAX_PACKET_SIZE);
-    Packet(char * data, qint64 size);
+    Packet(const char * data, qint64 size);
 
     static int HeaderSize(bool is_part_of_message);
     static int LocalHeaderSize(PacketType type);
@@ -405,10 +526,10 @@ public:
     int TotalHeaderSize();
 
     static std::unique_ptr<Packet> Create(uint32_t sequence, PacketType t, qint64 size = -1);
-    static std::unique_ptr<Packet> FromReceivedPacket(char * data, qint64 size);
+    static std::unique_ptr<Packet> FromReceivedPacket(const char * data, qint64 size);
 
     static std::unique_ptr<Packet> CreateControl(uint32_t sequence, ControlType t, qint64 size = -1);
-    static std::unique_ptr<Packet> FromReceivedControlPacket(char * data, qint64 size);
+    static std::unique_ptr<Packet> FromReceivedControlPacket(const char * data, qint64 size);
 
     void Obfuscate(ObfuscationLevel level);
 
@@ -441,8 +562,14 @@ public:
     uint32_t GetSequenceNumber() {return sequence_number;}
 
     static QByteArray HashForPacketAndHMAC(const Packet& packet, HMACAuth * hash);
+    // Same hash for several packets, computed side by side where HMACAuth supports it.
+    // Returns an empty list if any hash fails.
+    static QList<QByteArray> HashForPacketsAndHMAC(const QList<const Packet *>& packets, HMACAuth * hash);
 
 private:
+    // The hash covers everything after the verification hash field
+    static int HashedDataOffset(const Packet& packet);
+
     PacketType type;
     ControlType control_type;
     PacketVersion version;
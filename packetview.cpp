@@ -0,0 +1,99 @@
+#include <cstring>
+
+#include "packetview.h"
+#include "obfuscation.h"
+
+PacketView::PacketView(const char * d, int s)
+{
+    data = d;
+    size = s;
+    valid = false;
+    bit_field = 0;
+    header_size = 0;
+    type = PacketType::Unknown;
+    source_id_offset = -1;
+    hash_offset = -1;
+    payload_offset = 0;
+    memset(obfuscation_key, 0, sizeof(obfuscation_key));
+
+    if (size < (int) sizeof(quint32)) {
+        return;
+    }
+    memcpy(&bit_field, data, sizeof(quint32));
+
+    if (IsControl()) {
+        payload_offset = Packet::LocalControlHeaderSize();
+        valid = true;
+        return;
+    }
+
+    header_size = Packet::HeaderSize(IsPartOfMessage());
+    if (size < header_size + (int) (sizeof(PacketType) + sizeof(PacketVersion))) {
+        return;
+    }
+
+    if (IsObfuscated()) {
+        quint64 key = OBFUSCATION_KEYS[GetObfuscationLevel()];
+        memcpy(obfuscation_key, &key, sizeof(obfuscation_key));
+    }
+
+    type = (PacketType) ReadByte(header_size);
+
+    const int local_header_size = Packet::LocalHeaderSize(type);
+    const int optional_size = local_header_size - (int) (sizeof(PacketType) + sizeof(PacketVersion));
+    if (optional_size > 0) {
+        source_id_offset = header_size + sizeof(PacketType) + sizeof(PacketVersion);
+        if (optional_size > (int) sizeof(quint16)) {
+            hash_offset = source_id_offset + sizeof(quint16);
+        }
+    }
+
+    payload_offset = header_size + local_header_size;
+    valid = (size >= payload_offset);
+}
+
+quint16 PacketView::GetSourceID() const
+{
+    if (source_id_offset < 0) {
+        return 0;
+    }
+    // Local IDs go out in host order, same as Packet::WriteSourceID
+    quint8 bytes[sizeof(quint16)] = {ReadByte(source_id_offset), ReadByte(source_id_offset + 1)};
+    quint16 source_id;
+    memcpy(&source_id, bytes, sizeof(source_id));
+    return source_id;
+}
+
+bool PacketView::ReadPayload(int offset, void * dest, int len) const
+{
+    if (!valid || offset < 0 || len < 0 || payload_offset + offset + len > size) {
+        return false;
+    }
+
+    memcpy(dest, data + payload_offset + offset, len);
+    if (IsObfuscated()) {
+        quint64 key;
+        memcpy(&key, obfuscation_key, sizeof(key));
+        Obfuscation::XorInPlace(reinterpret_cast<char *>(dest), len, Obfuscation::RotateKey(key, (payload_offset + offset - header_size) % sizeof(quint64)));
+    }
+    return true;
+}
+
+quint8 PacketView::ReadByte(int offset) const
+{
+    // Obfuscation covers everything after the sequence number / message header
+    quint8 value = (quint8) data[offset];
+    if (offset >= header_size && header_size > 0) {
+        value ^= (quint8) obfuscation_key[(offset - header_size) % sizeof(quint64)];
+    }
+    return value;
+}
+
+quint32 PacketView::ReadWord(int offset) const
+{
+    quint32 value = 0;
+    if (offset + (int) sizeof(quint32) <= size) {
+        memcpy(&value, data + offset, sizeof(quint32));
+    }
+    return value;
+}
@@ -0,0 +1,72 @@
+#ifndef PACKETVIEW_H
+#define PACKETVIEW_H
+
+#include <QtGlobal>
+
+#include "packet.h"
+
+// Read-only view of a received datagram. Decodes the header in place without copying the buffer,
+// so classifying a packet costs a few loads instead of a full Packet. The buffer must outlive the view.
+//
+// An obfuscated packet still has its type, version, source ID and payload XORed with the key;
+// the getters and ReadPayload() undo that on the fly. GetPayload() hands out the raw bytes.
+class PacketView
+{
+public:
+    PacketView(const char * data, int size);
+
+    // False when the datagram is too short to hold the header its bit field announces
+    bool IsValid() const {return valid;}
+
+    const char * GetData() const {return data;}
+    int GetSize() const {return size;}
+
+    bool IsControl() const {return (bit_field & CONTROL_BIT_MASK) != 0;}
+    ControlType GetControlType() const {return (ControlType) ((bit_field & ~CONTROL_BIT_MASK) >> (8 * sizeof(ControlType)));}
+
+    bool IsReliable() const {return (bit_field & RELIABILITY_BIT_MASK) != 0;}
+    bool IsPartOfMessage() const {return (bit_field & MESSAGE_BIT_MASK) != 0;}
+    bool IsObfuscated() const {return GetObfuscationLevel() != 0;}
+    quint32 GetObfuscationLevel() const {return (bit_field & OBFUSCATION_LEVEL_MASK) >> OBFUSCATION_LEVEL_OFFSET;}
+    quint32 GetSequenceNumber() const {return bit_field & SEQUENCE_NUMBER_MASK;}
+
+    // Only meaningful for packets that are part of a message
+    quint32 GetMessageNumber() const {return ReadWord(sizeof(quint32)) & MESSAGE_NUMBER_MASK;}
+    quint32 GetPacketPosition() const {return ReadWord(sizeof(quint32)) >> PACKET_POSITION_OFFSET;}
+    quint32 GetMessagePartNumber() const {return ReadWord(2 * sizeof(quint32));}
+
+    PacketType GetType() const {return type;}
+    PacketVersion GetVersion() const {return (PacketVersion) ReadByte(header_size + sizeof(PacketType));}
+
+    // Source ID and verification hash are absent for some packet types, the offsets are -1 then
+    bool HasSourceID() const {return source_id_offset >= 0;}
+    quint16 GetSourceID() const;
+    int GetHashOffset() const {return hash_offset;}
+
+    int GetPayloadOffset() const {return payload_offset;}
+    const char * GetPayload() const {return data + payload_offset;}
+    int GetPayloadSize() const {return size - payload_offset;}
+
+    // Copies len payload bytes starting at offset into dest, deobfuscating them if needed
+    bool ReadPayload(int offset, void * dest, int len) const;
+
+private:
+    quint8 ReadByte(int offset) const;
+    quint32 ReadWord(int offset) const;
+
+    const char * data;
+    int size;
+    bool valid;
+
+    quint32 bit_field;
+    int header_size;
+    PacketType type;
+
+    int source_id_offset;
+    int hash_offset;
+    int payload_offset;
+
+    char obfuscation_key[sizeof(quint64)];
+};
+
+#endif // PACKETVIEW_H
@@ -0,0 +1,126 @@
+#include "placelookupcache.h"
+#include "metaverseclient.h"
+
+PlaceLookupCache& PlaceLookupCache::Instance()
+{
+    static PlaceLookupCache cache;
+    return cache;
+}
+
+PlaceLookupCache::PlaceLookupCache() :
+    num_hits(0),
+    num_stale_hits(0),
+    num_coalesced(0),
+    num_fetches(0)
+{
+    clock.start();
+}
+
+void PlaceLookupCache::Lookup(const QString& place_name, QObject * context, Callback callback)
+{
+    const QString key = place_name.toLower();
+    Waiter waiter = {context, callback};
+
+    QMutexLocker lock(&mutex);
+    Entry& entry = entries[key];
+    const qint64 age = (entry.fetched_at >= 0) ? clock.elapsed() - entry.fetched_at : -1;
+
+    if (age >= 0 && age < FRESH_MSEC) {
+        num_hits.ref();
+        Deliver(waiter, entry.place);
+        return;
+    }
+
+    if (age >= 0 && age < STALE_MSEC) {
+        num_stale_hits.ref();
+        Deliver(waiter, entry.place);
+        if (!entry.fetching) {
+            qDebug() << "PlaceLookupCache::Lookup() - Revalidating" << place_name;
+            Fetch(key, place_name);
+        }
+        return;
+    }
+
+    entry.waiters.append(waiter);
+    if (entry.fetching) {
+        num_coalesced.ref();
+        return;
+    }
+
+    Fetch(key, place_name);
+}
+
+void PlaceLookupCache::Fetch(const QString& key, const QString& place_name)
+{
+    entries[key].fetching = true;
+    num_fetches.ref();
+
+    QNetworkRequest request(MetaverseClient::METAVERSE_URL + "/api/v1/places/" + place_name);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    QNetworkReply * reply = MetaverseClient::ForCurrentThread().Get(request);
+
+    // Runs on this thread, where the reply lives, whichever connection started it
+    QObject::connect(reply, &QNetworkReply::finished, reply, [this, key, reply]() {
+        FetchFinished(key, reply);
+    });
+}
+
+void PlaceLookupCache::FetchFinished(const QString& key, QNetworkReply * reply)
+{
+    PlaceInfo place;
+    if (reply->error() == QNetworkReply::NoError) {
+        QJsonDocument doc = QJsonDocument::fromJson(reply->readAll());
+        QJsonObject data = doc.object()["data"].toObject();
+        QJsonObject domain = data["place"].toObject()["domain"].toObject();
+
+        place.domain_id = QUuid(domain["id"].toString());
+        place.default_place_name = domain["default_place_name"].toString();
+        if (domain.contains("ice_server_address")) {
+            place.ice_server_address = domain["ice_server_address"].toString();
+        }
+        place.valid = !place.domain_id.isNull();
+    }
+    else {
+        qDebug() << "PlaceLookupCache::FetchFinished() - Lookup failed for" << key << reply->errorString();
+    }
+    reply->deleteLater();
+
+    QList<Waiter> waiters;
+    {
+        QMutexLocker lock(&mutex);
+        Entry& entry = entries[key];
+        entry.fetching = false;
+
+        if (place.valid) {
+            entry.place = place;
+            entry.fetched_at = clock.elapsed();
+        }
+        else if (entry.fetched_at >= 0 && clock.elapsed() - entry.fetched_at < STALE_MSEC) {
+            // Keep serving what we had rather than failing everyone who is waiting
+            place = entry.place;
+        }
+        waiters.swap(entry.waiters);
+
+        // Failures are not cached, the next lookup tries again
+        if (entry.fetched_at < 0 && waiters.isEmpty()) {
+            entries.remove(key);
+        }
+    }
+
+    for (int i = 0; i < waiters.size(); i++) {
+        Deliver(waiters[i], place);
+    }
+}
+
+void PlaceLookupCache::Deliver(const Waiter& waiter, const PlaceInfo& place)
+{
+    if (!waiter.context) {
+        return;
+    }
+
+    // Queued onto the context's thread even on a hit, so callers see the same order of events either way
+    Callback callback = waiter.callback;
+    QTimer::singleShot(0, waiter.context.data(), [callback, place]() {
+        callback(place);
+    });
+}
@@ -0,0 +1,82 @@
+#ifndef PLACELOOKUPCACHE_H
+#define PLACELOOKUPCACHE_H
+
+#include <functional>
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QtNetwork>
+
+// What the metaverse API tells us about a place name
+struct PlaceInfo
+{
+    bool valid;
+    QUuid domain_id;
+    QString default_place_name;
+    QString ice_server_address; // empty when the domain uses the default ICE server
+
+    PlaceInfo() : valid(false) { }
+};
+
+// Process wide cache of /api/v1/places/<name> lookups, shared by every worker.
+//
+// A fresh entry answers straight away. A stale one still answers straight away and is refreshed in the
+// background. Lookups for a name that is already being fetched wait for that request instead of starting
+// their own, so a crowd joining the same domain costs one metaverse round trip.
+class PlaceLookupCache
+{
+public:
+    static const qint64 FRESH_MSEC = 60 * 1000;
+    static const qint64 STALE_MSEC = 10 * 60 * 1000; // served while revalidating, up to this age
+
+    typedef std::function<void(const PlaceInfo&)> Callback;
+
+    static PlaceLookupCache& Instance();
+
+    // callback always runs later on context's thread, and not at all if context is gone by then.
+    // A failed lookup reports an invalid PlaceInfo unless a stale entry can be served instead.
+    void Lookup(const QString& place_name, QObject * context, Callback callback);
+
+    quint64 GetNumHits() const {return num_hits.load();}
+    quint64 GetNumStaleHits() const {return num_stale_hits.load();}
+    quint64 GetNumCoalesced() const {return num_coalesced.load();}
+    quint64 GetNumFetches() const {return num_fetches.load();}
+
+private:
+    struct Waiter
+    {
+        QPointer<QObject> context;
+        Callback callback;
+    };
+
+    struct Entry
+    {
+        PlaceInfo place;
+        qint64 fetched_at; // on clock, -1 until the first successful fetch
+        bool fetching;
+        QList<Waiter> waiters;
+
+        Entry() : fetched_at(-1), fetching(false) { }
+    };
+
+    PlaceLookupCache();
+
+    // Called with mutex held, the request is issued from the calling thread
+    void Fetch(const QString& key, const QString& place_name);
+    void FetchFinished(const QString& key, QNetworkReply * reply);
+
+    static void Deliver(const Waiter& waiter, const PlaceInfo& place);
+
+    QMutex mutex;
+    QElapsedTimer clock;
+    QHash<QString, Entry> entries;
+
+    QAtomicInteger<quint64> num_hits;
+    QAtomicInteger<quint64> num_stale_hits;
+    QAtomicInteger<quint64> num_coalesced;
+    QAtomicInteger<quint64> num_fetches;
+};
+
+#endif // PLACELOOKUPCACHE_H
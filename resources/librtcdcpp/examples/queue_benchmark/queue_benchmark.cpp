@@ -0,0 +1,137 @@
+/**
+ * Throughput of the strand ring against the mutex-guarded ChunkQueue.
+ *
+ * Producers allocate chunks the size of a DTLS record and push them, one
+ * consumer drains them. The ring is sized and drained like a strand: 512 slots,
+ * batches of up to 64, and a full ring makes the producer back off.
+ */
+
+#include <rtcdcpp/ChunkQueue.hpp>
+#include <rtcdcpp/ChunkRing.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace rtcdcpp;
+
+namespace {
+
+const size_t CHUNK_SIZE = 1200;
+const size_t RING_CAPACITY = 512;
+const size_t MAX_BATCH = 64;
+
+struct Result {
+  double seconds;
+  size_t retries;
+};
+
+Result RunChunkQueue(int num_producers, size_t chunks_per_producer) {
+  ChunkQueue queue;
+  const size_t total = num_producers * chunks_per_producer;
+  uint8_t payload[CHUNK_SIZE] = {};
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < num_producers; p++) {
+    producers.emplace_back([&]() {
+      for (size_t i = 0; i < chunks_per_producer; i++) {
+        queue.push(Chunk::Create(payload, CHUNK_SIZE));
+      }
+    });
+  }
+
+  size_t bytes = 0;
+  for (size_t i = 0; i < total; i++) {
+    bytes += queue.wait_and_pop()->Size();
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  for (auto &producer : producers) {
+    producer.join();
+  }
+
+  if (bytes != total * CHUNK_SIZE) {
+    std::cerr << "ChunkQueue lost chunks" << std::endl;
+    std::exit(1);
+  }
+  return {std::chrono::duration<double>(end - start).count(), 0};
+}
+
+Result RunChunkRing(int num_producers, size_t chunks_per_producer) {
+  ChunkRing ring(RING_CAPACITY, num_producers == 1);
+  const size_t total = num_producers * chunks_per_producer;
+  uint8_t payload[CHUNK_SIZE] = {};
+  std::atomic<size_t> retries(0);
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < num_producers; p++) {
+    producers.emplace_back([&]() {
+      for (size_t i = 0; i < chunks_per_producer; i++) {
+        ChunkPtr chunk = Chunk::Create(payload, CHUNK_SIZE);
+        // The strand drops on a full ring, here the producer waits so both queues move the same data
+        while (!ring.Push(chunk)) {
+          retries.fetch_add(1, std::memory_order_relaxed);
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  size_t bytes = 0;
+  size_t popped = 0;
+  ChunkPtr batch[MAX_BATCH];
+  while (popped < total) {
+    size_t num_chunks = ring.PopBatch(batch, MAX_BATCH);
+    if (num_chunks == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    for (size_t i = 0; i < num_chunks; i++) {
+      bytes += batch[i]->Size();
+      batch[i].reset();
+    }
+    popped += num_chunks;
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  for (auto &producer : producers) {
+    producer.join();
+  }
+
+  if (bytes != total * CHUNK_SIZE) {
+    std::cerr << "ChunkRing lost chunks" << std::endl;
+    std::exit(1);
+  }
+  return {std::chrono::duration<double>(end - start).count(), retries.load()};
+}
+
+void Report(const char *name, int num_producers, size_t chunks_per_producer, const Result &result) {
+  const double total = (double)num_producers * chunks_per_producer;
+  std::cout << name << " producers=" << num_producers << " chunks=" << (size_t)total << " ns/chunk=" << (result.seconds * 1e9 / total)
+            << " Mchunks/s=" << (total / result.seconds / 1e6);
+  if (result.retries > 0) {
+    std::cout << " full_retries=" << result.retries;
+  }
+  std::cout << std::endl;
+}
+}
+
+int main(int argc, char **argv) {
+  size_t chunks_per_producer = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+  // Warm the chunk pool so neither run pays for the first blocks
+  RunChunkRing(1, 10000);
+
+  for (int num_producers : {1, 2, 4}) {
+    Report("ChunkQueue", num_producers, chunks_per_producer, RunChunkQueue(num_producers, chunks_per_producer));
+    Report("ChunkRing ", num_producers, chunks_per_producer, RunChunkRing(num_producers, chunks_per_producer));
+  }
+
+  return 0;
+}
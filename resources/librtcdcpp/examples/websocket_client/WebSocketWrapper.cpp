@@ -34,6 +34,6 @@ void WebSocketWrapper::Loop() {
   }
 }
 
-void WebSocketWrapper::Send(std::string msg) { this->send_queue.push(std::shared_ptr<Chunk>(new Chunk((const void*)msg.c_str(), msg.length()))); }
+void WebSocketWrapper::Send(std::string msg) { this->send_queue.push(Chunk::Create((const void*)msg.c_str(), msg.length())); }
 
 void WebSocketWrapper::Close() { this->stopping = true; this->send_loop.join(); }
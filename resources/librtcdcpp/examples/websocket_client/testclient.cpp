@@ -59,7 +59,7 @@ int main() {
   ChunkQueue messages;
 
   std::function<void(std::string)> onMessage = [&messages](std::string msg) {
-    messages.push(std::shared_ptr<Chunk>(new Chunk((const void *)msg.c_str(), msg.length())));
+    messages.push(Chunk::Create((const void *)msg.c_str(), msg.length()));
   };
 
   std::function<void(PeerConnection::IceCandidate)> onLocalIceCandidate = [&ws](PeerConnection::IceCandidate candidate) {
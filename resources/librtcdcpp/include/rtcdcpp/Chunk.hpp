@@ -27,48 +27,113 @@
 
 #pragma once
 
+#include "ChunkPool.hpp"
+
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <utility>
 
 #include <cstring>
 #include <condition_variable>
 namespace rtcdcpp {
 
+class Chunk;
+
+// Reference to a pooled Chunk. The count lives in the chunk itself, so there is no separate control block to allocate.
+class ChunkPtr {
+ public:
+  ChunkPtr() : chunk(nullptr) {}
+  ChunkPtr(std::nullptr_t) : chunk(nullptr) {}
+  ChunkPtr(const ChunkPtr &other);
+  ChunkPtr(ChunkPtr &&other) noexcept : chunk(other.chunk) { other.chunk = nullptr; }
+  ~ChunkPtr() { reset(); }
+
+  ChunkPtr &operator=(ChunkPtr other) noexcept {
+    std::swap(chunk, other.chunk);
+    return *this;
+  }
+
+  void reset();
+
+  Chunk *get() const { return chunk; }
+  Chunk *operator->() const { return chunk; }
+  Chunk &operator*() const { return *chunk; }
+  explicit operator bool() const { return chunk != nullptr; }
+
+ private:
+  friend class Chunk;
+
+  // Takes over the reference the pool handed out
+  explicit ChunkPtr(Chunk *chunk) : chunk(chunk) {}
+
+  Chunk *chunk;
+};
+
 // Utility class for passing messages around
 class Chunk {
  private:
+  friend class ChunkPtr;
+  friend class ChunkPool;
+
+  std::atomic<uint32_t> refs{1};
+  int size_class;
   size_t len{0};
   uint8_t *data{nullptr};
 
+  // Chunks only live in blocks handed out by ChunkPool, data points just past this header
+  Chunk(size_t dataLen, uint8_t *data, int size_class) : size_class(size_class), len(dataLen), data(data) {}
+
+  void AddRef() { refs.fetch_add(1, std::memory_order_relaxed); }
+  void Release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      ChunkPool::Free(this);
+    }
+  }
+
  public:
-  // TODO memory pool?
-  // XXX should we just use a vector?
+  Chunk(const Chunk &other) = delete;
+  Chunk &operator=(const Chunk &other) = delete;
 
   // Makes a copy of data
-  Chunk(const void *dataToCopy, size_t dataLen) : len(dataLen), data(new uint8_t[len]) { memcpy(data, dataToCopy, dataLen); }
+  static ChunkPtr Create(const void *dataToCopy, size_t dataLen) {
+    Chunk *chunk = ChunkPool::Allocate(dataLen);
+    memcpy(chunk->data, dataToCopy, dataLen);
+    return ChunkPtr(chunk);
+  }
 
-  // Copy constructor
-  Chunk(const Chunk &other) : len(other.len), data(new uint8_t[len]) { memcpy(data, other.data, other.len); }
+  // Leaves data uninitialized for the caller to fill in place
+  static ChunkPtr CreateUninitialized(size_t dataLen) { return ChunkPtr(ChunkPool::Allocate(dataLen)); }
 
-  // Assignment operator
-  Chunk &operator=(const Chunk &other) {
-    if (data) {
-      len = 0;
-      delete[] data;
+  // Shrinks the chunk to what was actually filled in. Only valid before the chunk is shared.
+  void Truncate(size_t newLen) {
+    if (newLen < len) {
+      len = newLen;
     }
-    len = other.len;
-    data = new uint8_t[len];
-    memcpy(data, other.data, other.len);
-    return *this;
   }
 
-  ~Chunk() { delete[] data; }
-
   size_t Size() const { return len; }
   size_t Length() const { return Size(); }
   uint8_t *Data() const { return data; }
 };
 
-using ChunkPtr = std::shared_ptr<Chunk>;
+inline ChunkPtr::ChunkPtr(const ChunkPtr &other) : chunk(other.chunk) {
+  if (chunk) {
+    chunk->AddRef();
+  }
+}
+
+inline void ChunkPtr::reset() {
+  if (chunk) {
+    chunk->Release();
+    chunk = nullptr;
+  }
+}
+
+// One segment of a scatter-gather send, the data is not copied or owned
+struct IoVec {
+  const void *base;
+  size_t len;
+};
 }
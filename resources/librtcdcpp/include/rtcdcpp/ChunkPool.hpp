@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2017, Andrew Gault, Nick Chadwick and Guillaume Egles.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the <organization> nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * Size-class pool backing every Chunk.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace rtcdcpp {
+
+class Chunk;
+
+struct ChunkPoolStats {
+  struct SizeClass {
+    size_t chunk_size;
+    uint64_t hits;         // served from a free list
+    uint64_t misses;       // had to allocate a new block
+    uint64_t blocks;       // blocks currently owned by the pool, in use or free
+    uint64_t peak_blocks;  // high-water mark of blocks
+  };
+
+  std::vector<SizeClass> size_classes;
+  uint64_t unpooled;  // chunks too large for any size class
+};
+
+/**
+ * Chunks are carved from fixed-size blocks, one size class for small control
+ * packets, one for a typical DTLS record or SCTP packet and one for the
+ * largest buffers the pipeline reads into. Each thread keeps a small free list
+ * per class, so allocating a chunk is usually a pop from it. Threads trade
+ * blocks with a shared list in batches, which matters because chunks are
+ * often freed on a different thread than the one that allocated them.
+ */
+class ChunkPool {
+ public:
+  static Chunk *Allocate(size_t len);
+  static void Free(Chunk *chunk);
+
+  // Hit and miss counts reach the shared totals every few hundred allocations per thread, so they can lag a little behind
+  static ChunkPoolStats GetStats();
+};
+}
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2017, Andrew Gault, Nick Chadwick and Guillaume Egles.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the <organization> nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * Bounded lock-free queue of chunks.
+ */
+
+#pragma once
+
+#include "Chunk.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace rtcdcpp {
+
+/**
+ * Fixed-capacity ring with a single consumer and either one or many producers.
+ * Every slot carries a sequence number (Vyukov's bounded queue), so producers
+ * and the consumer never take a lock. With a single producer the tail is simply
+ * stored instead of claimed with a compare-and-swap.
+ */
+class ChunkRing {
+ public:
+  // capacity is rounded up to a power of two
+  ChunkRing(size_t capacity, bool single_producer) : mask(RoundUp(capacity) - 1), single_producer(single_producer), slots(mask + 1), head(0) {
+    for (size_t i = 0; i <= mask; i++) {
+      slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  ChunkRing(const ChunkRing &) = delete;
+  ChunkRing &operator=(const ChunkRing &) = delete;
+
+  // Returns false when the ring is full
+  bool Push(ChunkPtr chunk) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots[pos & mask];
+      size_t seq = slot->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff < 0) {
+        return false;
+      } else if (diff > 0) {
+        pos = tail.load(std::memory_order_relaxed);
+      } else if (single_producer) {
+        tail.store(pos + 1, std::memory_order_relaxed);
+        break;
+      } else if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+
+    slot->chunk = std::move(chunk);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Moves up to max_chunks into out and returns how many.
+  size_t PopBatch(ChunkPtr *out, size_t max_chunks) {
+    size_t popped = 0;
+    while (popped < max_chunks) {
+      Slot *slot = &slots[head & mask];
+      if (slot->seq.load(std::memory_order_acquire) != head + 1) {
+        break;
+      }
+      out[popped++] = std::move(slot->chunk);
+      slot->seq.store(head + mask + 1, std::memory_order_release);
+      head++;
+    }
+    return popped;
+  }
+
+  size_t Capacity() const { return mask + 1; }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    ChunkPtr chunk;
+  };
+
+  static size_t RoundUp(size_t n) {
+    size_t size = 2;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  const size_t mask;
+  const bool single_producer;
+  std::vector<Slot> slots;
+
+  // Consumer and producers write to different cache lines
+  alignas(64) size_t head;
+  alignas(64) std::atomic<size_t> tail;
+};
+}
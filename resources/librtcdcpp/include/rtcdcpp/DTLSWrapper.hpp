@@ -34,10 +34,12 @@
 #include "ChunkQueue.hpp"
 #include "PeerConnection.hpp"
 #include "Logging.hpp"
+#include "Reactor.hpp"
 
 #include <openssl/ssl.h>
 
 #include <thread>
+#include <vector>
 
 namespace rtcdcpp {
 
@@ -64,20 +66,41 @@ class DTLSWrapper {
 
   std::atomic<bool> should_stop;
 
-  ChunkQueue encrypt_queue;
-  ChunkQueue decrypt_queue;
+  // Both stay paused until Start() has begun the handshake.
+  // Only the nice context thread feeds the decrypt strand.
+  Strand encrypt_strand;
+  Strand decrypt_strand;
 
-  std::thread encrypt_thread;
-  std::thread decrypt_thread;
-
-  void RunEncrypt();
-  void RunDecrypt();
+  void RunEncrypt(ChunkPtr chunk);
+  void RunDecrypt(ChunkPtr chunk);
 
   // SSL Context
   std::mutex ssl_mutex;
   SSL_CTX *ctx;
   SSL *ssl;
-  BIO *in_bio, *out_bio;
+
+  // Custom BIO used for both directions. OpenSSL reads the datagram being decrypted straight out of its
+  // chunk, and its writes are packed into pooled chunks, one per outgoing datagram.
+  BIO *bio;
+  ChunkPtr bio_in_chunk;
+  size_t bio_in_offset;
+  ChunkPtr bio_out_chunk;
+  size_t bio_out_len;
+
+  // Datagrams finished by the BIO, sent once the SSL call returns. Guarded by ssl_mutex.
+  std::vector<ChunkPtr> encrypted_chunks;
+  // Records read from one datagram. Only the decrypt strand touches it.
+  std::vector<ChunkPtr> decrypted_chunks;
+
+  void FinishDatagram();
+  void SendEncryptedChunks();
+
+  static BIO_METHOD *ChunkBIOMethod();
+  static int ChunkBIOWrite(BIO *b, const char *data, int len);
+  static int ChunkBIORead(BIO *b, char *data, int len);
+  static long ChunkBIOCtrl(BIO *b, int cmd, long num, void *ptr);
+  static int ChunkBIOCreate(BIO *b);
+  static int ChunkBIODestroy(BIO *b);
 
   bool handshake_complete;
 
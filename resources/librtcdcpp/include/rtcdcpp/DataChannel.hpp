@@ -134,6 +134,12 @@ class DataChannel {
   bool SendString(std::string msg);
   bool SendBinary(const uint8_t *msg, int len);
 
+  /**
+   * Send the concatenation of iovcnt segments as one binary message,
+   * without the caller having to build a contiguous buffer.
+   */
+  bool SendBinary(const IoVec *iov, int iovcnt);
+
   // Callbacks
 
   /**
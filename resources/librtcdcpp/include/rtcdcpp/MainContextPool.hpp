@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) 2017, Andrew Gault, Nick Chadwick and Guillaume Egles.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the <organization> nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * Shared GLib main loops that drive every NiceAgent.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <glib.h>
+}
+
+namespace rtcdcpp {
+
+/**
+ * A small, fixed set of GMainContexts, each polled by its own thread.
+ * Agents are spread over them instead of every peer running a GMainLoop of its own.
+ */
+class MainContextPool {
+ public:
+  explicit MainContextPool(size_t num_contexts);
+  virtual ~MainContextPool();
+
+  /**
+   * Process wide pool with one context per core, created on first use.
+   */
+  static MainContextPool &Instance();
+
+  // Hand out the context with the fewest agents attached. Pair every call with Release().
+  GMainContext *Acquire();
+  void Release(GMainContext *context);
+
+  /**
+   * Run func on the thread polling context and wait for it to return.
+   * Runs it in place when called from that thread.
+   */
+  static void InvokeAndWait(GMainContext *context, std::function<void()> func);
+
+  size_t GetNumContexts() const { return slots.size(); }
+
+ private:
+  struct Slot {
+    GMainContext *context;
+    GMainLoop *loop;
+    std::thread thread;
+    size_t num_agents;
+  };
+
+  std::mutex mtx;
+  std::vector<Slot> slots;
+};
+}
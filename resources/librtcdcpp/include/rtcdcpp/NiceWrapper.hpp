@@ -34,6 +34,8 @@
 #include "ChunkQueue.hpp"
 #include "PeerConnection.hpp"
 #include "Logging.hpp"
+#include "MainContextPool.hpp"
+#include "Reactor.hpp"
 
 #include <thread>
 
@@ -56,10 +58,7 @@ class NiceWrapper {
   // Setup libnice
   bool Initialize();
 
-  // Start sending packets XXX: recv just happens once candidates are set
-  void StartSendLoop();
-
-  // Shutdown nice and stop the send thread
+  // Shutdown nice and stop sending
   void Stop();
 
   // Parse the remote SDP
@@ -90,21 +89,19 @@ class NiceWrapper {
   int packets_sent;
 
   std::unique_ptr<NiceAgent, void (*)(gpointer)> agent;
-  std::unique_ptr<GMainLoop, void (*)(GMainLoop *)> loop;
+  // Shared context from MainContextPool, polled on one of its threads
+  GMainContext *context;
   uint32_t stream_id;
   std::mutex send_lock;
 
   bool gathering_done;
   bool negotiation_done;
 
-  ChunkQueue send_queue;
-
   std::function<void(ChunkPtr)> data_received_callback;
 
-  // Send data thread
-  void SendLoop();
-  std::thread send_thread;
-  std::thread g_main_loop_thread;
+  // Sends run on the shared reactor, in order
+  void SendChunk(ChunkPtr chunk);
+  Strand send_strand;
   std::atomic<bool> should_stop;
 
   // Callback methods
@@ -117,6 +117,7 @@ class PeerConnection {
 
   void SendStrMsg(std::string msg, uint16_t sid);
   void SendBinaryMsg(const uint8_t *data, int len, uint16_t sid);
+  void SendBinaryMsg(const IoVec *iov, int iovcnt, uint16_t sid);
 
   /* Internal Callback Handlers */
   void OnLocalIceCandidate(std::string &ice_candidate);
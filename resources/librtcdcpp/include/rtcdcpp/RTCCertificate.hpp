@@ -43,6 +43,8 @@ namespace rtcdcpp {
 class RTCCertificate {
  public:
   static RTCCertificate GenerateCertificate(std::string common_name, int days);
+  // P-256 key: generated in well under a millisecond, where RSA takes tens, and a much smaller handshake
+  static RTCCertificate GenerateECDSACertificate(std::string common_name, int days);
 
   RTCCertificate(std::string cert_pem, std::string pkey_pem);
 
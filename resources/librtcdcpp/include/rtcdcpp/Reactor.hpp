@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2017, Andrew Gault, Nick Chadwick and Guillaume Egles.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the <organization> nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * Shared worker pool driving the Nice, DTLS and SCTP stages of every peer.
+ */
+
+#pragma once
+
+#include "ChunkRing.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rtcdcpp {
+
+/**
+ * Fixed-size pool of threads. Thread count scales with cores, not peers.
+ */
+class Reactor {
+ public:
+  explicit Reactor(size_t num_threads);
+  virtual ~Reactor();
+
+  /**
+   * Process wide reactor with one thread per core, created on first use.
+   */
+  static Reactor &Instance();
+
+  void Post(std::function<void()> task);
+
+  size_t GetNumThreads() const { return threads.size(); }
+
+ private:
+  std::mutex mtx;
+  std::condition_variable task_cond;
+  std::deque<std::function<void()>> tasks;
+  bool stopping;
+
+  std::vector<std::thread> threads;
+
+  void Run();
+};
+
+/**
+ * Runs one pipeline stage of one peer on a Reactor.
+ * Chunks pushed to a strand are handled in order and never concurrently,
+ * the strand only occupies a reactor thread while it has work queued.
+ *
+ * Pushing is lock-free. Only the push that finds the strand idle posts a drain
+ * to the reactor, every other push just lands in the ring.
+ */
+class Strand {
+ public:
+  using Handler = std::function<void(ChunkPtr)>;
+
+  // A paused strand queues chunks until Start() is called.
+  // Pass single_producer when only one thread at a time ever pushes.
+  Strand(Reactor &reactor, Handler handler, bool paused = false, bool single_producer = false);
+  virtual ~Strand();
+
+  void Start();
+
+  // Drops the chunk if the ring is full
+  void Push(ChunkPtr chunk);
+
+  /**
+   * Drop queued chunks and wait for a handler that is already running to return.
+   * No handler is called once Stop() returns.
+   */
+  void Stop();
+
+  uint64_t GetNumDropped() const { return state->dropped.load(std::memory_order_relaxed); }
+
+ private:
+  // Handlers are posted with a reference to this state, so a strand can go away while a drain is still queued
+  struct State {
+    State(Reactor *reactor, Handler handler, bool single_producer);
+
+    Reactor *reactor;
+    Handler handler;
+    ChunkRing ring;
+
+    // Chunks pushed but not yet drained, plus a large bias while paused
+    std::atomic<int64_t> pending;
+    std::atomic<bool> started;
+    std::atomic<bool> stopping;
+    std::atomic<uint64_t> dropped;
+
+    // Taken once per drain, not per chunk, so Stop() can wait for a running handler
+    std::mutex mtx;
+    std::condition_variable idle_cond;
+    bool running;
+    std::thread::id running_thread;
+  };
+
+  std::shared_ptr<State> state;
+
+  static void Schedule(const std::shared_ptr<State> &state);
+  static void Drain(const std::shared_ptr<State> &state);
+};
+}
@@ -33,7 +33,9 @@
 
 #include "ChunkQueue.hpp"
 #include "PeerConnection.hpp"
+#include "Reactor.hpp"
 
+#include <mutex>
 #include <thread>
 
 #include <usrsctp.h>
@@ -63,6 +65,7 @@ class SCTPWrapper {
   // Send a message to the remote connection
   // Note, this will cause 1+ DTLSEncrypt callback calls
   void GSForSCTP(ChunkPtr chunk, uint16_t sid, uint32_t ppid);
+  void GSForSCTP(const IoVec *iov, int iovcnt, uint16_t sid, uint32_t ppid);
 
  private:
   //  PeerConnection *peer_connection;
@@ -72,22 +75,18 @@ class SCTPWrapper {
   uint16_t remote_port;
   int stream_cursor;
 
-  bool connectSentData{false};
-  std::mutex connectMtx;
-  std::condition_variable connectCV;
-
-  ChunkQueue send_queue;
-  ChunkQueue recv_queue;
+  std::atomic<bool> connectSentData{false};
 
   const DTLSEncryptCallbackPtr dtlsEncryptCallback;
   const MsgReceivedCallbackPtr msgReceivedCallback;
 
   std::atomic<bool> should_stop{false};
-  std::thread recv_thread;
-  std::thread connect_thread;
+
+  // Paused until the connect has sent its first packet, fed only by the DTLS decrypt strand
+  Strand recv_strand;
 
   void RunConnect();
-  void RecvLoop();
+  void RecvChunk(ChunkPtr chunk);
 
   // SCTP has output a packet ready for DTLS
   int OnSCTPForDTLS(void *data, size_t len, uint8_t tos, uint8_t set_df);
@@ -106,6 +105,7 @@ class SCTPWrapper {
 
   std::shared_ptr<Logger> logger = GetLogger("rtcdcpp.SCTP");
 
-  static bool usrsctp_initialized;
+  // usrsctp is process wide, peers created on different threads share one initialization
+  static std::once_flag usrsctp_init_flag;
 };
 }
@@ -0,0 +1,221 @@
+/**
+ * Copyright (c) 2017, Andrew Gault, Nick Chadwick and Guillaume Egles.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the <organization> nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * Size-class pool backing every Chunk.
+ */
+
+#include "rtcdcpp/Chunk.hpp"
+
+#include <mutex>
+#include <new>
+
+namespace rtcdcpp {
+
+using namespace std;
+
+// Blocks a thread keeps per class before handing a batch back
+#define CHUNK_POOL_THREAD_MAX 64
+// Blocks moved between a thread and the shared list at once
+#define CHUNK_POOL_TRANSFER_BATCH 32
+// Free blocks the shared list keeps per class, the rest go back to the system
+#define CHUNK_POOL_SHARED_MAX 4096
+// Allocations a thread counts per class before adding them to the shared totals. A thread in a steady state
+// never refills or spills, so this is what keeps GetStats() within a few hundred of the truth.
+#define CHUNK_POOL_STATS_FLUSH 256
+
+namespace {
+
+const size_t size_classes[] = {256, 1280, 2048};
+const int num_size_classes = sizeof(size_classes) / sizeof(size_classes[0]);
+
+struct FreeBlock {
+  FreeBlock *next;
+};
+
+struct SharedList {
+  std::mutex mtx;
+  FreeBlock *head;
+  size_t count;
+
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> blocks;
+  std::atomic<uint64_t> peak_blocks;
+};
+
+SharedList shared_lists[num_size_classes];
+std::atomic<uint64_t> unpooled_chunks(0);
+
+struct ThreadCache {
+  FreeBlock *head[num_size_classes];
+  size_t count[num_size_classes];
+  uint64_t hits[num_size_classes];
+  uint64_t misses[num_size_classes];
+
+  ThreadCache() {
+    for (int i = 0; i < num_size_classes; i++) {
+      head[i] = nullptr;
+      count[i] = 0;
+      hits[i] = 0;
+      misses[i] = 0;
+    }
+  }
+
+  ~ThreadCache() {
+    for (int i = 0; i < num_size_classes; i++) {
+      Spill(i, count[i]);
+    }
+  }
+
+  void FlushStats(int size_class) {
+    shared_lists[size_class].hits.fetch_add(hits[size_class], std::memory_order_relaxed);
+    shared_lists[size_class].misses.fetch_add(misses[size_class], std::memory_order_relaxed);
+    hits[size_class] = 0;
+    misses[size_class] = 0;
+  }
+
+  void Refill(int size_class) {
+    SharedList &shared = shared_lists[size_class];
+    std::lock_guard<std::mutex> lock(shared.mtx);
+    for (int i = 0; i < CHUNK_POOL_TRANSFER_BATCH && shared.head; i++) {
+      FreeBlock *block = shared.head;
+      shared.head = block->next;
+      shared.count--;
+
+      block->next = head[size_class];
+      head[size_class] = block;
+      count[size_class]++;
+    }
+    FlushStats(size_class);
+  }
+
+  void Spill(int size_class, size_t num_blocks) {
+    SharedList &shared = shared_lists[size_class];
+    std::lock_guard<std::mutex> lock(shared.mtx);
+    for (size_t i = 0; i < num_blocks && head[size_class]; i++) {
+      FreeBlock *block = head[size_class];
+      head[size_class] = block->next;
+      count[size_class]--;
+
+      if (shared.count < CHUNK_POOL_SHARED_MAX) {
+        block->next = shared.head;
+        shared.head = block;
+        shared.count++;
+      } else {
+        ::operator delete(block);
+        shared.blocks.fetch_sub(1, std::memory_order_relaxed);
+      }
+    }
+    FlushStats(size_class);
+  }
+};
+
+thread_local ThreadCache thread_cache;
+
+int SizeClassFor(size_t len) {
+  for (int i = 0; i < num_size_classes; i++) {
+    if (len <= size_classes[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+}
+
+Chunk *ChunkPool::Allocate(size_t len) {
+  int size_class = SizeClassFor(len);
+  if (size_class < 0) {
+    unpooled_chunks.fetch_add(1, std::memory_order_relaxed);
+    void *block = ::operator new(sizeof(Chunk) + len);
+    return new (block) Chunk(len, reinterpret_cast<uint8_t *>(block) + sizeof(Chunk), -1);
+  }
+
+  ThreadCache &cache = thread_cache;
+  if (!cache.head[size_class]) {
+    cache.Refill(size_class);
+  }
+
+  void *block = cache.head[size_class];
+  if (block) {
+    cache.head[size_class] = cache.head[size_class]->next;
+    cache.count[size_class]--;
+    cache.hits[size_class]++;
+  } else {
+    block = ::operator new(sizeof(Chunk) + size_classes[size_class]);
+    cache.misses[size_class]++;
+
+    SharedList &shared = shared_lists[size_class];
+    uint64_t blocks = shared.blocks.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint64_t peak = shared.peak_blocks.load(std::memory_order_relaxed);
+    while (blocks > peak && !shared.peak_blocks.compare_exchange_weak(peak, blocks, std::memory_order_relaxed)) {
+    }
+  }
+
+  if (cache.hits[size_class] + cache.misses[size_class] >= CHUNK_POOL_STATS_FLUSH) {
+    cache.FlushStats(size_class);
+  }
+
+  return new (block) Chunk(len, reinterpret_cast<uint8_t *>(block) + sizeof(Chunk), size_class);
+}
+
+void ChunkPool::Free(Chunk *chunk) {
+  int size_class = chunk->size_class;
+  chunk->~Chunk();
+
+  if (size_class < 0) {
+    ::operator delete(chunk);
+    return;
+  }
+
+  ThreadCache &cache = thread_cache;
+  FreeBlock *block = reinterpret_cast<FreeBlock *>(chunk);
+  block->next = cache.head[size_class];
+  cache.head[size_class] = block;
+  cache.count[size_class]++;
+
+  if (cache.count[size_class] > CHUNK_POOL_THREAD_MAX) {
+    cache.Spill(size_class, CHUNK_POOL_TRANSFER_BATCH);
+  }
+}
+
+ChunkPoolStats ChunkPool::GetStats() {
+  ChunkPoolStats stats;
+  for (int i = 0; i < num_size_classes; i++) {
+    ChunkPoolStats::SizeClass size_class;
+    size_class.chunk_size = size_classes[i];
+    size_class.hits = shared_lists[i].hits.load(std::memory_order_relaxed);
+    size_class.misses = shared_lists[i].misses.load(std::memory_order_relaxed);
+    size_class.blocks = shared_lists[i].blocks.load(std::memory_order_relaxed);
+    size_class.peak_blocks = shared_lists[i].peak_blocks.load(std::memory_order_relaxed);
+    stats.size_classes.push_back(size_class);
+  }
+  stats.unpooled = unpooled_chunks.load(std::memory_order_relaxed);
+  return stats;
+}
+}
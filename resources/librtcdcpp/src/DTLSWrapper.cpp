@@ -32,6 +32,7 @@
 #include "rtcdcpp/DTLSWrapper.hpp"
 #include "rtcdcpp/RTCCertificate.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 #include <openssl/bio.h>
@@ -42,8 +43,35 @@ namespace rtcdcpp {
 
 using namespace std;
 
+namespace {
+// Records are packed into one datagram up to this size, which matches the path MTU SCTP is configured with
+const long DTLS_MTU = 1200;
+// Pooled size class that fits a full datagram or a full SCTP packet once decrypted
+const size_t DATAGRAM_CAPACITY = 2048;
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+void *GetBIOData(BIO *b) { return b->ptr; }
+void SetBIOData(BIO *b, void *ptr) { b->ptr = ptr; }
+void SetBIOInit(BIO *b, int init) { b->init = init; }
+#else
+void *GetBIOData(BIO *b) { return BIO_get_data(b); }
+void SetBIOData(BIO *b, void *ptr) { BIO_set_data(b, ptr); }
+void SetBIOInit(BIO *b, int init) { BIO_set_init(b, init); }
+#endif
+}
+
 DTLSWrapper::DTLSWrapper(PeerConnection *peer_connection)
-    : peer_connection(peer_connection), certificate_(nullptr), handshake_complete(false), should_stop(false) {
+    : peer_connection(peer_connection),
+      certificate_(nullptr),
+      should_stop(false),
+      encrypt_strand(Reactor::Instance(), std::bind(&DTLSWrapper::RunEncrypt, this, std::placeholders::_1), true),
+      decrypt_strand(Reactor::Instance(), std::bind(&DTLSWrapper::RunDecrypt, this, std::placeholders::_1), true, true),
+      ctx(nullptr),
+      ssl(nullptr),
+      bio(nullptr),
+      bio_in_offset(0),
+      bio_out_len(0),
+      handshake_complete(false) {
   if (peer_connection->config().certificates.size() != 1) {
     throw std::runtime_error("At least one and only one certificate has to be set");
   }
@@ -55,7 +83,7 @@ DTLSWrapper::DTLSWrapper(PeerConnection *peer_connection)
 DTLSWrapper::~DTLSWrapper() {
   Stop();
 
-  // NOTE: We intentionally do NOT free the BIO's manually
+  // NOTE: The BIO belongs to ssl and is freed along with it
 
   if (ssl) {
     if (SSL_shutdown(ssl) == 0) {
@@ -75,6 +103,116 @@ static int verify_peer_certificate(int ok, X509_STORE_CTX *ctx) {
   return 1;
 }
 
+BIO_METHOD *DTLSWrapper::ChunkBIOMethod() {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+  static BIO_METHOD method = {BIO_TYPE_SOURCE_SINK,         "rtcdcpp chunk", ChunkBIOWrite,  ChunkBIORead,   nullptr,
+                              nullptr,                      ChunkBIOCtrl,    ChunkBIOCreate, ChunkBIODestroy, nullptr};
+  return &method;
+#else
+  static BIO_METHOD *method = [] {
+    BIO_METHOD *m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "rtcdcpp chunk");
+    BIO_meth_set_write(m, ChunkBIOWrite);
+    BIO_meth_set_read(m, ChunkBIORead);
+    BIO_meth_set_ctrl(m, ChunkBIOCtrl);
+    BIO_meth_set_create(m, ChunkBIOCreate);
+    BIO_meth_set_destroy(m, ChunkBIODestroy);
+    return m;
+  }();
+  return method;
+#endif
+}
+
+// Every write is a complete record. Records share a datagram until it would go over the MTU or OpenSSL flushes.
+int DTLSWrapper::ChunkBIOWrite(BIO *b, const char *data, int len) {
+  DTLSWrapper *self = static_cast<DTLSWrapper *>(GetBIOData(b));
+  BIO_clear_retry_flags(b);
+  if (len <= 0) {
+    return 0;
+  }
+
+  if (self->bio_out_len > 0 && self->bio_out_len + len > (size_t)DTLS_MTU) {
+    self->FinishDatagram();
+  }
+  if (!self->bio_out_chunk) {
+    self->bio_out_chunk = Chunk::CreateUninitialized(std::max((size_t)len, DATAGRAM_CAPACITY));
+  }
+
+  memcpy(self->bio_out_chunk->Data() + self->bio_out_len, data, len);
+  self->bio_out_len += len;
+  return len;
+}
+
+// Hands over the whole datagram in one read, like a datagram socket, then reports that nothing is left
+int DTLSWrapper::ChunkBIORead(BIO *b, char *data, int len) {
+  DTLSWrapper *self = static_cast<DTLSWrapper *>(GetBIOData(b));
+  BIO_clear_retry_flags(b);
+
+  if (!self->bio_in_chunk || self->bio_in_offset >= self->bio_in_chunk->Length()) {
+    BIO_set_retry_read(b);
+    return -1;
+  }
+
+  size_t available = self->bio_in_chunk->Length() - self->bio_in_offset;
+  int nbytes = (int)std::min(available, (size_t)std::max(len, 0));
+  memcpy(data, self->bio_in_chunk->Data() + self->bio_in_offset, nbytes);
+  self->bio_in_offset = self->bio_in_chunk->Length();
+  return nbytes;
+}
+
+long DTLSWrapper::ChunkBIOCtrl(BIO *b, int cmd, long num, void *ptr) {
+  DTLSWrapper *self = static_cast<DTLSWrapper *>(GetBIOData(b));
+
+  switch (cmd) {
+    case BIO_CTRL_FLUSH:
+      // The end of a handshake flight, or of a fragment that filled the MTU
+      self->FinishDatagram();
+      return 1;
+    case BIO_CTRL_PENDING:
+      return self->bio_in_chunk ? (long)(self->bio_in_chunk->Length() - self->bio_in_offset) : 0;
+    case BIO_CTRL_WPENDING:
+      // Lets OpenSSL fit handshake fragments into what is left of the current datagram
+      return (long)self->bio_out_len;
+    case BIO_CTRL_DGRAM_QUERY_MTU:
+#ifdef BIO_CTRL_DGRAM_GET_FALLBACK_MTU
+    case BIO_CTRL_DGRAM_GET_FALLBACK_MTU:
+#endif
+      return DTLS_MTU;
+    default:
+      return 0;
+  }
+}
+
+int DTLSWrapper::ChunkBIOCreate(BIO *b) {
+  SetBIOInit(b, 1);
+  SetBIOData(b, nullptr);
+  return 1;
+}
+
+int DTLSWrapper::ChunkBIODestroy(BIO *b) {
+  // The DTLSWrapper owns the state, there is nothing to free
+  SetBIOData(b, nullptr);
+  return 1;
+}
+
+void DTLSWrapper::FinishDatagram() {
+  if (bio_out_len == 0) {
+    return;
+  }
+  bio_out_chunk->Truncate(bio_out_len);
+  encrypted_chunks.push_back(std::move(bio_out_chunk));
+  bio_out_chunk.reset();
+  bio_out_len = 0;
+}
+
+// Called with ssl_mutex held, so datagrams from both strands go out in the order OpenSSL produced them
+void DTLSWrapper::SendEncryptedChunks() {
+  FinishDatagram();
+  for (ChunkPtr &chunk : encrypted_chunks) {
+    this->encrypted_callback(std::move(chunk));
+  }
+  encrypted_chunks.clear();
+}
+
 bool DTLSWrapper::Initialize() {
   SSL_library_init();
   OpenSSL_add_all_algorithms();
@@ -102,19 +240,14 @@ bool DTLSWrapper::Initialize() {
     return false;
   }
 
-  in_bio = BIO_new(BIO_s_mem());
-  if (!in_bio) {
+  bio = BIO_new(ChunkBIOMethod());
+  if (!bio) {
     return false;
   }
-  BIO_set_mem_eof_return(in_bio, -1);
+  SetBIOData(bio, this);
 
-  out_bio = BIO_new(BIO_s_mem());
-  if (!out_bio) {
-    return false;
-  }
-  BIO_set_mem_eof_return(out_bio, -1);
-
-  SSL_set_bio(ssl, in_bio, out_bio);
+  // One BIO for both directions, ssl takes the single reference
+  SSL_set_bio(ssl, bio, bio);
 
   std::shared_ptr<EC_KEY> ecdh = std::shared_ptr<EC_KEY>(EC_KEY_new_by_curve_name(NID_X9_62_prime256v1), EC_KEY_free);
   SSL_set_options(ssl, SSL_OP_SINGLE_ECDH_USE);
@@ -127,126 +260,98 @@ void DTLSWrapper::Start() {
   SPDLOG_TRACE(logger, "Start(): Starting handshake - {}", std::this_thread::get_id());
 
   // XXX: We can never be the server (sdp always returns active, not passive)
-  SSL_set_connect_state(ssl);
-  uint8_t buf[4192];
-  SSL_do_handshake(ssl);
-  while (BIO_ctrl_pending(out_bio) > 0) {
-    // XXX: This is not actually valid (buf + offset send after)
-    int nbytes = BIO_read(out_bio, buf, sizeof(buf));
-    if (nbytes > 0) {
-      SPDLOG_TRACE(logger, "Start(): Sending handshake bytes {}", nbytes);
-      this->encrypted_callback(std::make_shared<Chunk>(buf, nbytes));
-    }
+  {
+    std::lock_guard<std::mutex> lock(this->ssl_mutex);
+    SSL_set_connect_state(ssl);
+    SSL_do_handshake(ssl);
+    SendEncryptedChunks();
   }
 
-  // std::cerr << "DTLS: handshake started, start encrypt/decrypt threads" << std::endl;
-  this->encrypt_thread = std::thread(&DTLSWrapper::RunEncrypt, this);
-  this->decrypt_thread = std::thread(&DTLSWrapper::RunDecrypt, this);
+  // std::cerr << "DTLS: handshake started, start encrypt/decrypt strands" << std::endl;
+  this->encrypt_strand.Start();
+  this->decrypt_strand.Start();
 }
 
 void DTLSWrapper::Stop() {
   this->should_stop = true;
 
-  encrypt_queue.Stop();
-  if (this->encrypt_thread.joinable()) {
-    this->encrypt_thread.join();
-  }
-
-  decrypt_queue.Stop();
-  if (this->decrypt_thread.joinable()) {
-    this->decrypt_thread.join();
-  }
+  encrypt_strand.Stop();
+  decrypt_strand.Stop();
 }
 
 void DTLSWrapper::SetEncryptedCallback(std::function<void(ChunkPtr chunk)> encrypted_callback) { this->encrypted_callback = encrypted_callback; }
 
 void DTLSWrapper::SetDecryptedCallback(std::function<void(ChunkPtr chunk)> decrypted_callback) { this->decrypted_callback = decrypted_callback; }
 
-void DTLSWrapper::DecryptData(ChunkPtr chunk) { this->decrypt_queue.push(chunk); }
+void DTLSWrapper::DecryptData(ChunkPtr chunk) { this->decrypt_strand.Push(chunk); }
 
-void DTLSWrapper::RunDecrypt() {
+// Called on the reactor for each queued chunk
+void DTLSWrapper::RunDecrypt(ChunkPtr chunk) {
   SPDLOG_TRACE(logger, "RunDecrypt()");
 
   bool should_notify = false;
-  while (!should_stop) {
-    int read_bytes = 0;
-    uint8_t buf[2048] = {0};
-    ChunkPtr chunk = this->decrypt_queue.wait_and_pop();
-    if (!chunk) {
-      return;
-    }
-    size_t cur_len = chunk->Length();
-
-    {
-      std::lock_guard<std::mutex> lock(this->ssl_mutex);
-
-      // std::cout << "DTLS: Decrypting data of size - " << chunk->Length() << std::endl;
-      BIO_write(in_bio, chunk->Data(), (int)chunk->Length());
-      read_bytes = SSL_read(ssl, buf, sizeof(buf));
-
-      if (!handshake_complete) {
-        if (BIO_ctrl_pending(out_bio)) {
-          uint8_t out_buf[2048];
-          int send_bytes = 0;
-          while (BIO_ctrl_pending(out_bio) > 0) {
-            send_bytes += BIO_read(out_bio, out_buf + send_bytes, sizeof(out_buf) - send_bytes);
-          }
-          if (send_bytes > 0) {
-            this->encrypted_callback(std::make_shared<Chunk>(out_buf, send_bytes));
-          }
-        }
 
-        if (SSL_is_init_finished(ssl)) {
-          handshake_complete = true;
-          should_notify = true;
+  {
+    std::lock_guard<std::mutex> lock(this->ssl_mutex);
+
+    // std::cout << "DTLS: Decrypting data of size - " << chunk->Length() << std::endl;
+    bio_in_chunk = std::move(chunk);
+    bio_in_offset = 0;
+
+    // A datagram can carry several records, read until OpenSSL wants the next datagram
+    ChunkPtr plain;
+    while (true) {
+      if (!plain) {
+        plain = Chunk::CreateUninitialized(DATAGRAM_CAPACITY);
+      }
+      int read_bytes = SSL_read(ssl, plain->Data(), (int)DATAGRAM_CAPACITY);
+      if (read_bytes <= 0) {
+        int error = SSL_get_error(ssl, read_bytes);
+        if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_ZERO_RETURN) {
+          logger->warn("RunDecrypt(): SSL_read failed - {}", error);
         }
+        break;
       }
+      plain->Truncate((size_t)read_bytes);
+      decrypted_chunks.push_back(std::move(plain));
+      plain.reset();
     }
+    bio_in_chunk.reset();
 
-    // std::cerr << "Read this many bytes " << read_bytes << std::endl;
-    if (read_bytes > 0) {
-      // std::cerr << "DTLS: Calling decrypted callback with data of size: " << read_bytes << std::endl;
-      this->decrypted_callback(std::make_shared<Chunk>(buf, read_bytes));
-    } else {
-      // TODO: SSL error checking
-    }
+    // Handshake replies, or alerts
+    SendEncryptedChunks();
 
-    if (should_notify) {
-      // std::cerr << "DTLS: handshake is done" << std::endl;
-      should_notify = false;
-      peer_connection->OnDTLSHandshakeDone();
+    if (!handshake_complete && SSL_is_init_finished(ssl)) {
+      handshake_complete = true;
+      should_notify = true;
     }
   }
-}
 
-void DTLSWrapper::EncryptData(ChunkPtr chunk) { this->encrypt_queue.push(chunk); }
+  // std::cerr << "DTLS: Calling decrypted callback with " << decrypted_chunks.size() << " records" << std::endl;
+  for (ChunkPtr &plain : decrypted_chunks) {
+    this->decrypted_callback(std::move(plain));
+  }
+  decrypted_chunks.clear();
 
-void DTLSWrapper::RunEncrypt() {
-  SPDLOG_TRACE(logger, "RunEncrypt()");
-  while (!this->should_stop) {
-    ChunkPtr chunk = this->encrypt_queue.wait_and_pop();
-    if (!chunk) {
-      return;
-    }
+  if (should_notify) {
+    // std::cerr << "DTLS: handshake is done" << std::endl;
+    peer_connection->OnDTLSHandshakeDone();
+  }
+}
 
-    // std::cerr << "DTLS: Encrypting message of len - " << chunk->Length() << std::endl;
-    {
-      std::lock_guard<std::mutex> lock(this->ssl_mutex);
-      uint8_t buf[2048] = {0};
-      if (SSL_write(ssl, chunk->Data(), (int)chunk->Length()) != chunk->Length()) {
-        // TODO: Error handling
-      }
+void DTLSWrapper::EncryptData(ChunkPtr chunk) { this->encrypt_strand.Push(chunk); }
 
-      int nbytes = 0;
-      while (BIO_ctrl_pending(out_bio) > 0) {
-        nbytes += BIO_read(out_bio, buf + nbytes, 2048 - nbytes);
-      }
+// Called on the reactor for each queued chunk
+void DTLSWrapper::RunEncrypt(ChunkPtr chunk) {
+  SPDLOG_TRACE(logger, "RunEncrypt()");
 
-      if (nbytes > 0) {
-        // std::cerr << "DTLS: Calling the encrypted data cb" << std::endl;
-        this->encrypted_callback(std::make_shared<Chunk>(buf, nbytes));
-      }
-    }
+  // std::cerr << "DTLS: Encrypting message of len - " << chunk->Length() << std::endl;
+  std::lock_guard<std::mutex> lock(this->ssl_mutex);
+  if (SSL_write(ssl, chunk->Data(), (int)chunk->Length()) != (int)chunk->Length()) {
+    // TODO: Error handling
   }
+
+  // The record went straight into a pooled chunk
+  SendEncryptedChunks();
 }
 }
@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2017, Andrew Gault, Nick Chadwick and Guillaume Egles.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the <organization> nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * Shared GLib main loops that drive every NiceAgent.
+ */
+
+#include "rtcdcpp/MainContextPool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+
+namespace rtcdcpp {
+
+using namespace std;
+
+MainContextPool::MainContextPool(size_t num_contexts) : slots(std::max<size_t>(num_contexts, 1)) {
+  for (auto &slot : slots) {
+    slot.context = g_main_context_new();
+    slot.loop = g_main_loop_new(slot.context, FALSE);
+    slot.num_agents = 0;
+    slot.thread = std::thread(g_main_loop_run, slot.loop);
+  }
+}
+
+MainContextPool::~MainContextPool() {
+  for (auto &slot : slots) {
+    g_main_loop_quit(slot.loop);
+    if (slot.thread.joinable()) {
+      slot.thread.join();
+    }
+    g_main_loop_unref(slot.loop);
+    g_main_context_unref(slot.context);
+  }
+}
+
+MainContextPool &MainContextPool::Instance() {
+  static MainContextPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+GMainContext *MainContextPool::Acquire() {
+  std::lock_guard<std::mutex> lock(mtx);
+  auto least_loaded = std::min_element(slots.begin(), slots.end(), [](const Slot &a, const Slot &b) { return a.num_agents < b.num_agents; });
+  least_loaded->num_agents++;
+  return least_loaded->context;
+}
+
+void MainContextPool::Release(GMainContext *context) {
+  std::lock_guard<std::mutex> lock(mtx);
+  for (auto &slot : slots) {
+    if (slot.context == context && slot.num_agents > 0) {
+      slot.num_agents--;
+      return;
+    }
+  }
+}
+
+namespace {
+struct PendingCall {
+  std::function<void()> func;
+  std::mutex mtx;
+  std::condition_variable done_cond;
+  bool done;
+};
+
+gboolean RunPendingCall(gpointer user_data) {
+  PendingCall *call = static_cast<PendingCall *>(user_data);
+  call->func();
+
+  // Notify under the lock: call lives on the waiter's stack, and the waiter may return as soon as it sees done
+  std::lock_guard<std::mutex> lock(call->mtx);
+  call->done = true;
+  call->done_cond.notify_one();
+  return FALSE;
+}
+}
+
+void MainContextPool::InvokeAndWait(GMainContext *context, std::function<void()> func) {
+  if (g_main_context_is_owner(context)) {
+    func();
+    return;
+  }
+
+  PendingCall call;
+  call.func = func;
+  call.done = false;
+  g_main_context_invoke(context, RunPendingCall, &call);
+
+  std::unique_lock<std::mutex> lock(call.mtx);
+  while (!call.done) {
+    call.done_cond.wait(lock);
+  }
+}
+}
@@ -33,6 +33,7 @@
 
 #include <sstream>
 
+#include <arpa/inet.h>
 #include <netdb.h>
 
 void ReplaceAll(std::string &s, const std::string &search, const std::string &replace) {
@@ -48,7 +49,13 @@ namespace rtcdcpp {
 using namespace std;
 
 NiceWrapper::NiceWrapper(PeerConnection *peer_connection)
-    : peer_connection(peer_connection), stream_id(0), should_stop(false), send_queue(), agent(NULL, nullptr), loop(NULL, nullptr), packets_sent(0) {
+    : peer_connection(peer_connection),
+      stream_id(0),
+      should_stop(false),
+      send_strand(Reactor::Instance(), std::bind(&NiceWrapper::SendChunk, this, std::placeholders::_1)),
+      agent(NULL, nullptr),
+      context(nullptr),
+      packets_sent(0) {
   data_received_callback = [](ChunkPtr x) { ; };
   nice_debug_disable(true);
 }
@@ -132,7 +139,7 @@ void data_received(NiceAgent *agent, guint stream_id, guint component_id, guint
 
 void NiceWrapper::OnDataReceived(const uint8_t *buf, int len) {
   SPDLOG_TRACE(logger, "Nice data IN: {}", len);
-  this->data_received_callback(std::make_shared<Chunk>(buf, len));
+  this->data_received_callback(Chunk::Create(buf, len));
 }
 
 void nice_log_handler(const gchar *log_domain, GLogLevelFlags log_level, const gchar *message, gpointer user_data) {
@@ -147,20 +154,14 @@ bool NiceWrapper::Initialize() {
 
   int log_flags = G_LOG_LEVEL_MASK | G_LOG_FLAG_FATAL | G_LOG_FLAG_RECURSION;
   g_log_set_handler(NULL, (GLogLevelFlags)log_flags, nice_log_handler, this);
-  this->loop = std::unique_ptr<GMainLoop, void (*)(GMainLoop *)>(g_main_loop_new(NULL, FALSE), g_main_loop_unref);
-  if (!this->loop) {
-    SPDLOG_TRACE(logger, "Failed to initialize GMainLoop");
-  }
+  this->context = MainContextPool::Instance().Acquire();
 
-  this->agent = std::unique_ptr<NiceAgent, decltype(&g_object_unref)>(nice_agent_new(g_main_loop_get_context(loop.get()), NICE_COMPATIBILITY_RFC5245),
-                                                                      g_object_unref);
+  this->agent = std::unique_ptr<NiceAgent, decltype(&g_object_unref)>(nice_agent_new(this->context, NICE_COMPATIBILITY_RFC5245), g_object_unref);
   if (!this->agent) {
     SPDLOG_TRACE(logger, "Failed to initialize nice agent");
     return false;
   }
 
-  this->g_main_loop_thread = std::thread(g_main_loop_run, this->loop.get());
-
   g_object_set(G_OBJECT(agent.get()), "upnp", FALSE, NULL);
   g_object_set(G_OBJECT(agent.get()), "controlling-mode", 0, NULL);
 
@@ -169,12 +170,18 @@ bool NiceWrapper::Initialize() {
   }
 
   for (auto ice_server : config.ice_servers) {
-    struct hostent *stun_host = gethostbyname(ice_server.hostname.c_str());
-    if (stun_host == nullptr) {
+    // Callers are expected to pass an address (the relay resolves it once for everyone), in which case
+    // this returns without touching DNS. gethostbyname() is not thread safe and agents start on many threads.
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *stun_host = nullptr;
+    if (getaddrinfo(ice_server.hostname.c_str(), nullptr, &hints, &stun_host) != 0 || stun_host == nullptr) {
       logger->warn("Failed to lookup host for server: {}", ice_server);
     } else {
-      in_addr *address = (in_addr *)stun_host->h_addr;
-      const char *ip_address = inet_ntoa(*address);
+      char ip_address[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &((struct sockaddr_in *)stun_host->ai_addr)->sin_addr, ip_address, sizeof(ip_address));
+      freeaddrinfo(stun_host);
 
       g_object_set(G_OBJECT(agent.get()), "stun-server", ip_address, NULL);
     }
@@ -207,23 +214,28 @@ bool NiceWrapper::Initialize() {
     nice_agent_set_port_range(agent.get(), this->stream_id, 1, config.ice_port_range.first, config.ice_port_range.second);
   }
 
-  return (bool)nice_agent_attach_recv(agent.get(), this->stream_id, 1, g_main_loop_get_context(loop.get()), data_received, this);
+  return (bool)nice_agent_attach_recv(agent.get(), this->stream_id, 1, this->context, data_received, this);
 }
 
-void NiceWrapper::StartSendLoop() { this->send_thread = std::thread(&NiceWrapper::SendLoop, this); }
-
 void NiceWrapper::Stop() {
   this->should_stop = true;
 
-  send_queue.Stop();
-  if (this->send_thread.joinable()) {
-    this->send_thread.join();
-  }
-
-  g_main_loop_quit(this->loop.get());
-
-  if (this->g_main_loop_thread.joinable()) {
-    this->g_main_loop_thread.join();
+  send_strand.Stop();
+
+  if (this->context) {
+    // The context is shared, so detach from it on its own thread. Once this returns no callback for this peer is running or will run.
+    MainContextPool::InvokeAndWait(this->context, [this]() {
+      if (this->agent) {
+        g_signal_handlers_disconnect_by_data(this->agent.get(), this);
+        if (this->stream_id != 0) {
+          nice_agent_attach_recv(this->agent.get(), this->stream_id, 1, this->context, NULL, NULL);
+        }
+        this->agent.reset();
+      }
+    });
+
+    MainContextPool::Instance().Release(this->context);
+    this->context = nullptr;
   }
 }
 
@@ -252,27 +264,21 @@ void NiceWrapper::SendData(ChunkPtr chunk) {
     return;
   }
 
-  this->send_queue.push(chunk);
+  this->send_strand.Push(chunk);
 }
 
-// Pull items off the send queue and call nice_agent_send
-void NiceWrapper::SendLoop() {
-  while (!this->should_stop) {
-    ChunkPtr chunk = send_queue.wait_and_pop();
-    if (!chunk) {
-      return;
-    }
-    size_t cur_len = chunk->Length();
-    int result = 0;
-    // std::cerr << "ICE: Sending data of len " << cur_len << std::endl;
-    SPDLOG_TRACE(logger, "Nice data OUT: {}", cur_len);
-    result = nice_agent_send(this->agent.get(), this->stream_id, 1, (guint)cur_len, (const char *)chunk->Data());
-    if (result != cur_len) {
-      SPDLOG_TRACE(logger, "ICE: Failed to send data of len - {}", cur_len);
-      SPDLOG_TRACE(logger, "ICE: Failed send result - {}", result);
-    } else {
-      // std::cerr << "ICE: Data sent " << cur_len << std::endl;
-    }
+// Called on the reactor for each queued chunk
+void NiceWrapper::SendChunk(ChunkPtr chunk) {
+  size_t cur_len = chunk->Length();
+  int result = 0;
+  // std::cerr << "ICE: Sending data of len " << cur_len << std::endl;
+  SPDLOG_TRACE(logger, "Nice data OUT: {}", cur_len);
+  result = nice_agent_send(this->agent.get(), this->stream_id, 1, (guint)cur_len, (const char *)chunk->Data());
+  if (result != cur_len) {
+    SPDLOG_TRACE(logger, "ICE: Failed to send data of len - {}", cur_len);
+    SPDLOG_TRACE(logger, "ICE: Failed send result - {}", result);
+  } else {
+    // std::cerr << "ICE: Data sent " << cur_len << std::endl;
   }
 }
 
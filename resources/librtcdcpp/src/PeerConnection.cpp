@@ -47,7 +47,8 @@ std::ostream &operator<<(std::ostream &os, const RTCIceServer &ice_server) { ret
 PeerConnection::PeerConnection(const RTCConfiguration &config, IceCandidateCallbackPtr icCB, DataChannelCallbackPtr dcCB)
     : config_(config), ice_candidate_cb(icCB), new_channel_cb(dcCB) {
   if (config_.certificates.empty()) {
-    config_.certificates.push_back(RTCCertificate::GenerateCertificate("rtcdcpp", 365));
+    // Callers with many peers should pass one shared certificate, generating costs a key per peer otherwise
+    config_.certificates.push_back(RTCCertificate::GenerateECDSACertificate("rtcdcpp", 365));
   }
   if (!Initialize()) {
     throw runtime_error("Could not initialize");
@@ -88,7 +89,6 @@ bool PeerConnection::Initialize() {
   nice->SetDataReceivedCallback(std::bind(&DTLSWrapper::DecryptData, dtls.get(), std::placeholders::_1));
   dtls->SetDecryptedCallback(std::bind(&SCTPWrapper::DTLSForSCTP, sctp.get(), std::placeholders::_1));
   dtls->SetEncryptedCallback(std::bind(&NiceWrapper::SendData, nice.get(), std::placeholders::_1));
-  nice->StartSendLoop();
   return true;
 }
 
@@ -263,12 +263,14 @@ void PeerConnection::HandleBinaryMessage(ChunkPtr chunk, uint16_t sid) {
 }
 
 void PeerConnection::SendStrMsg(std::string str_msg, uint16_t sid) {
-  auto cur_msg = std::make_shared<Chunk>((const uint8_t *)str_msg.c_str(), str_msg.size());
-  this->sctp->GSForSCTP(cur_msg, sid, PPID_STRING);
+  IoVec iov = {str_msg.c_str(), str_msg.size()};
+  this->sctp->GSForSCTP(&iov, 1, sid, PPID_STRING);
 }
 
 void PeerConnection::SendBinaryMsg(const uint8_t *data, int len, uint16_t sid) {
-  auto cur_msg = std::make_shared<Chunk>(data, len);
-  this->sctp->GSForSCTP(cur_msg, sid, PPID_BINARY);
+  IoVec iov = {data, (size_t)len};
+  this->sctp->GSForSCTP(&iov, 1, sid, PPID_BINARY);
 }
+
+void PeerConnection::SendBinaryMsg(const IoVec *iov, int iovcnt, uint16_t sid) { this->sctp->GSForSCTP(iov, iovcnt, sid, PPID_BINARY); }
 }
@@ -31,6 +31,7 @@
 
 #include "rtcdcpp/RTCCertificate.hpp"
 
+#include <openssl/ec.h>
 #include <openssl/pem.h>
 
 namespace rtcdcpp {
@@ -81,7 +82,7 @@ static std::shared_ptr<X509> GenerateX509(std::shared_ptr<EVP_PKEY> evp_pkey, co
     return null_result;
   }
 
-  if (!X509_sign(x509.get(), evp_pkey.get(), EVP_sha1())) {
+  if (!X509_sign(x509.get(), evp_pkey.get(), EVP_sha256())) {
     return null_result;
   }
 
@@ -99,9 +100,11 @@ static std::string GenerateFingerprint(std::shared_ptr<X509> x509) {
     throw std::runtime_error("GenerateFingerprint(): fingerprint size too large for buffer!");
   }
 
+  // "XX:" per byte, the last separator becomes the terminator. The extra byte is for snprintf's own
+  // terminator after the last separator.
   int offset = 0;
-  char fp[SHA256_FINGERPRINT_SIZE];
-  memset(fp, 0, SHA256_FINGERPRINT_SIZE);
+  char fp[SHA256_FINGERPRINT_SIZE + 1];
+  memset(fp, 0, sizeof(fp));
   for (unsigned int i = 0; i < len; ++i) {
     snprintf(fp + offset, 4, "%02X:", buf[i]);
     offset += 3;
@@ -131,6 +134,30 @@ RTCCertificate RTCCertificate::GenerateCertificate(std::string common_name, int
   return RTCCertificate(cert, pkey);
 }
 
+RTCCertificate RTCCertificate::GenerateECDSACertificate(std::string common_name, int days) {
+  // Generated through EVP_PKEY_CTX, the EC_KEY functions are deprecated in OpenSSL 3
+  std::shared_ptr<EVP_PKEY_CTX> ctx(EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr), EVP_PKEY_CTX_free);
+
+  if (!ctx) {
+    throw std::runtime_error("GenerateECDSACertificate: !ctx");
+  }
+
+  // Browsers only accept named curves, not explicit parameters
+  EVP_PKEY *raw_pkey = nullptr;
+  if (EVP_PKEY_keygen_init(ctx.get()) <= 0 || EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx.get(), NID_X9_62_prime256v1) <= 0 ||
+      EVP_PKEY_CTX_set_ec_param_enc(ctx.get(), OPENSSL_EC_NAMED_CURVE) <= 0 || EVP_PKEY_keygen(ctx.get(), &raw_pkey) <= 0) {
+    throw std::runtime_error("GenerateECDSACertificate: Error generating key");
+  }
+  std::shared_ptr<EVP_PKEY> pkey(raw_pkey, EVP_PKEY_free);
+
+  auto cert = GenerateX509(pkey, common_name, days);
+
+  if (!cert) {
+    throw std::runtime_error("GenerateECDSACertificate: Error in GenerateX509");
+  }
+  return RTCCertificate(cert, pkey);
+}
+
 RTCCertificate::RTCCertificate(std::string cert_pem, std::string pkey_pem) {
   /* x509 */
   BIO *bio = BIO_new(BIO_s_mem());
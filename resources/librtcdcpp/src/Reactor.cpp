@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) 2017, Andrew Gault, Nick Chadwick and Guillaume Egles.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *    * Neither the name of the <organization> nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * Shared worker pool and per-peer strands.
+ */
+
+#include "rtcdcpp/Reactor.hpp"
+#include "rtcdcpp/Logging.hpp"
+
+#include <algorithm>
+
+namespace rtcdcpp {
+
+using namespace std;
+
+// Chunks handled per turn before a busy strand yields its thread to other peers
+#define STRAND_MAX_BATCH 64
+
+// Chunks a strand can hold before it starts dropping
+#define STRAND_CAPACITY 512
+
+// Keeps the pending count of a paused strand away from zero, so no push schedules it
+#define STRAND_PAUSED_BIAS (int64_t(1) << 40)
+
+Reactor::Reactor(size_t num_threads) : stopping(false) {
+  for (size_t i = 0; i < std::max<size_t>(num_threads, 1); i++) {
+    threads.emplace_back(&Reactor::Run, this);
+  }
+}
+
+Reactor::~Reactor() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  task_cond.notify_all();
+
+  for (auto &thread : threads) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+Reactor &Reactor::Instance() {
+  static Reactor reactor(std::max(2u, std::thread::hardware_concurrency()));
+  return reactor;
+}
+
+void Reactor::Post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (stopping) {
+      return;
+    }
+    tasks.push_back(std::move(task));
+  }
+  task_cond.notify_one();
+}
+
+void Reactor::Run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      while (!stopping && tasks.empty()) {
+        task_cond.wait(lock);
+      }
+      if (stopping) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+Strand::State::State(Reactor *reactor, Handler handler, bool single_producer)
+    : reactor(reactor),
+      handler(handler),
+      ring(STRAND_CAPACITY, single_producer),
+      pending(0),
+      started(false),
+      stopping(false),
+      dropped(0),
+      running(false) {}
+
+Strand::Strand(Reactor &reactor, Handler handler, bool paused, bool single_producer)
+    : state(std::make_shared<State>(&reactor, handler, single_producer)) {
+  if (paused) {
+    state->pending.store(STRAND_PAUSED_BIAS);
+  } else {
+    state->started.store(true);
+  }
+}
+
+Strand::~Strand() { Stop(); }
+
+void Strand::Start() {
+  if (state->started.exchange(true)) {
+    return;
+  }
+
+  // Whatever was pushed while paused is still waiting for a drain
+  int64_t prev = state->pending.fetch_sub(STRAND_PAUSED_BIAS, std::memory_order_acq_rel);
+  if (prev > STRAND_PAUSED_BIAS) {
+    Schedule(state);
+  }
+}
+
+void Strand::Push(ChunkPtr chunk) {
+  if (state->stopping.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  if (!state->ring.Push(std::move(chunk))) {
+    if (state->dropped.fetch_add(1, std::memory_order_relaxed) == 0) {
+      GetLogger("rtcdcpp.Reactor")->warn("Strand queue full, dropping chunks");
+    }
+    return;
+  }
+
+  // The chunk is in the ring before it is counted, so whoever drains after this sees it
+  if (state->pending.fetch_add(1, std::memory_order_acq_rel) == 0) {
+    Schedule(state);
+  }
+}
+
+void Strand::Stop() {
+  std::unique_lock<std::mutex> lock(state->mtx);
+  state->stopping.store(true, std::memory_order_release);
+
+  // A handler stopping its own strand must not wait for itself, its drain releases the rest
+  if (state->running && state->running_thread == std::this_thread::get_id()) {
+    return;
+  }
+
+  while (state->running) {
+    state->idle_cond.wait(lock);
+  }
+
+  // No drain can start anymore, so this is the only consumer left
+  ChunkPtr batch[STRAND_MAX_BATCH];
+  while (state->ring.PopBatch(batch, STRAND_MAX_BATCH) > 0) {
+  }
+}
+
+void Strand::Schedule(const std::shared_ptr<State> &state) {
+  std::shared_ptr<State> strand_state = state;
+  state->reactor->Post([strand_state]() { Drain(strand_state); });
+}
+
+void Strand::Drain(const std::shared_ptr<State> &state) {
+  {
+    std::lock_guard<std::mutex> lock(state->mtx);
+    if (state->stopping.load(std::memory_order_acquire)) {
+      return;
+    }
+    state->running = true;
+    state->running_thread = std::this_thread::get_id();
+  }
+
+  ChunkPtr batch[STRAND_MAX_BATCH];
+  size_t num_chunks = state->ring.PopBatch(batch, STRAND_MAX_BATCH);
+  for (size_t i = 0; i < num_chunks && !state->stopping.load(std::memory_order_acquire); i++) {
+    state->handler(std::move(batch[i]));
+  }
+
+  // Idle before the count drops: once it does, a Push can schedule the next drain, and that drain must not
+  // have its running flag cleared by this one while its handler runs (Stop() would return under it)
+  {
+    std::lock_guard<std::mutex> lock(state->mtx);
+    state->running = false;
+  }
+  state->idle_cond.notify_all();
+
+  // Pushes racing with the pop can leave this briefly negative, their own increment then sees no transition from zero
+  int64_t remaining = state->pending.fetch_sub((int64_t)num_chunks, std::memory_order_acq_rel) - (int64_t)num_chunks;
+
+  if (remaining > 0 && !state->stopping.load(std::memory_order_acquire)) {
+    // Still busy, queue up behind the other peers instead of hogging the thread
+    Schedule(state);
+  }
+}
+}
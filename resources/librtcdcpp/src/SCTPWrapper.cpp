@@ -32,19 +32,21 @@
 #include "rtcdcpp/SCTPWrapper.hpp"
 
 #include <iostream>
+#include <vector>
 
 namespace rtcdcpp {
 
 using namespace std;
 
-bool SCTPWrapper::usrsctp_initialized = false;
+std::once_flag SCTPWrapper::usrsctp_init_flag;
 
 SCTPWrapper::SCTPWrapper(DTLSEncryptCallbackPtr dtlsEncryptCB, MsgReceivedCallbackPtr msgReceivedCB)
     : local_port(5000),  // XXX: Hard-coded for now
       remote_port(5000),
       stream_cursor(0),
       dtlsEncryptCallback(dtlsEncryptCB),
-      msgReceivedCallback(msgReceivedCB) {}
+      msgReceivedCallback(msgReceivedCB),
+      recv_strand(Reactor::Instance(), std::bind(&SCTPWrapper::RecvChunk, this, std::placeholders::_1), true, true) {}
 
 SCTPWrapper::~SCTPWrapper() {
   Stop();
@@ -123,12 +125,11 @@ int SCTPWrapper::_OnSCTPForDTLS(void *sctp_ptr, void *data, size_t len, uint8_t
 
 int SCTPWrapper::OnSCTPForDTLS(void *data, size_t len, uint8_t tos, uint8_t set_df) {
   SPDLOG_TRACE(logger, "Data ready. len={}, tos={}, set_df={}", len, tos, set_df);
-  this->dtlsEncryptCallback(std::make_shared<Chunk>(data, len));
+  this->dtlsEncryptCallback(Chunk::Create(data, len));
 
-  {
-    unique_lock<mutex> l(connectMtx);
-    this->connectSentData = true;
-    connectCV.notify_one();
+  if (!this->connectSentData.exchange(true)) {
+    // The INIT is out, incoming packets can be handed to usrsctp now
+    recv_strand.Start();
   }
 
   return 0;  // success
@@ -176,15 +177,14 @@ int SCTPWrapper::OnSCTPForGS(struct socket *sock, union sctp_sockstore addr, voi
 }
 
 void SCTPWrapper::OnMsgReceived(const uint8_t *data, size_t len, int ppid, int sid) {
-  this->msgReceivedCallback(std::make_shared<Chunk>(data, len), ppid, sid);
+  this->msgReceivedCallback(Chunk::Create(data, len), ppid, sid);
 }
 
 bool SCTPWrapper::Initialize() {
-  if (!usrsctp_initialized) {
-      usrsctp_initialized = true;
-      usrsctp_init(0, &SCTPWrapper::_OnSCTPForDTLS, &SCTPWrapper::_DebugLog);
-      usrsctp_sysctl_set_sctp_ecn_enable(0);
-  }
+  std::call_once(usrsctp_init_flag, []() {
+    usrsctp_init(0, &SCTPWrapper::_OnSCTPForDTLS, &SCTPWrapper::_DebugLog);
+    usrsctp_sysctl_set_sctp_ecn_enable(0);
+  });
   usrsctp_register_address(this);
 
   sock = usrsctp_socket(AF_CONN, SOCK_STREAM, IPPROTO_SCTP, &SCTPWrapper::_OnSCTPForGS, NULL, 0, this);
@@ -272,24 +272,13 @@ void SCTPWrapper::Start() {
   SPDLOG_TRACE(logger, "Start()");
   started = true;
 
-  this->recv_thread = std::thread(&SCTPWrapper::RecvLoop, this);
-  this->connect_thread = std::thread(&SCTPWrapper::RunConnect, this);
+  RunConnect();
 }
 
 void SCTPWrapper::Stop() {
   this->should_stop = true;
 
-  send_queue.Stop();
-  recv_queue.Stop();
-
-  connectCV.notify_one();  // unblock the recv thread in case we never connected
-  if (this->recv_thread.joinable()) {
-    this->recv_thread.join();
-  }
-
-  if (this->connect_thread.joinable()) {
-    this->connect_thread.join();
-  }
+  recv_strand.Stop();
 
   if (sock) {
     usrsctp_shutdown(sock, SHUT_RDWR);
@@ -298,10 +287,15 @@ void SCTPWrapper::Stop() {
   }
 }
 
-void SCTPWrapper::DTLSForSCTP(ChunkPtr chunk) { this->recv_queue.push(chunk); }
+void SCTPWrapper::DTLSForSCTP(ChunkPtr chunk) { this->recv_strand.Push(chunk); }
 
 // Send a message to the remote connection
 void SCTPWrapper::GSForSCTP(ChunkPtr chunk, uint16_t sid, uint32_t ppid) {
+  IoVec iov = {chunk->Data(), chunk->Length()};
+  GSForSCTP(&iov, 1, sid, ppid);
+}
+
+void SCTPWrapper::GSForSCTP(const IoVec *iov, int iovcnt, uint16_t sid, uint32_t ppid) {
   struct sctp_sendv_spa spa = {0};
 
   // spa.sendv_flags = SCTP_SEND_SNDINFO_VALID | SCTP_SEND_PRINFO_VALID;
@@ -315,9 +309,36 @@ void SCTPWrapper::GSForSCTP(ChunkPtr chunk, uint16_t sid, uint32_t ppid) {
   // spa.sendv_prinfo.pr_policy = SCTP_PR_SCTP_RTX;
   // spa.sendv_prinfo.pr_value = 0;
 
+  // usrsctp_sendv only takes a single buffer. One segment is handed over as is,
+  // several are gathered once, on the stack unless the message is unusually large.
+  const void *data = nullptr;
+  size_t len = 0;
+  uint8_t gather_buf[2048];
+  std::vector<uint8_t> gather_heap;
+
+  if (iovcnt == 1) {
+    data = iov[0].base;
+    len = iov[0].len;
+  } else {
+    for (int i = 0; i < iovcnt; i++) {
+      len += iov[i].len;
+    }
+    uint8_t *dst = gather_buf;
+    if (len > sizeof(gather_buf)) {
+      gather_heap.resize(len);
+      dst = gather_heap.data();
+    }
+    size_t offset = 0;
+    for (int i = 0; i < iovcnt; i++) {
+      memcpy(dst + offset, iov[i].base, iov[i].len);
+      offset += iov[i].len;
+    }
+    data = dst;
+  }
+
   int tries = 0;
   while (tries < 5) {
-    if (usrsctp_sendv(this->sock, chunk->Data(), chunk->Length(), NULL, 0, &spa, sizeof(spa), SCTP_SENDV_SPA, 0) < 0) {
+    if (usrsctp_sendv(this->sock, data, len, NULL, 0, &spa, sizeof(spa), SCTP_SENDV_SPA, 0) < 0) {
       logger->error("FAILED to send, try: {}", tries);
       tries += 1;
       std::this_thread::sleep_for(std::chrono::seconds(tries));
@@ -329,34 +350,13 @@ void SCTPWrapper::GSForSCTP(ChunkPtr chunk, uint16_t sid, uint32_t ppid) {
   throw std::runtime_error("Send failed");
 }
 
-void SCTPWrapper::RecvLoop() {
-  // Util::SetThreadName("SCTP-RecvLoop");
-//  NDC ndc("SCTP-RecvLoop");
-
-  SPDLOG_TRACE(logger, "RunRecv()");
-
-  {
-    // We need to wait for the connect thread to send some data
-    unique_lock<mutex> l(connectMtx);
-    while (!this->connectSentData && !this->should_stop) {
-      connectCV.wait_for(l, chrono::milliseconds(100));
-    }
-  }
-
-  SPDLOG_DEBUG(logger, "RunRecv() sent_data=true");
-
-  while (!this->should_stop) {
-    ChunkPtr chunk = this->recv_queue.wait_and_pop();
-    if (!chunk) {
-      return;
-    }
-    SPDLOG_DEBUG(logger, "RunRecv() Handling packet of len - {}", chunk->Length());
-    usrsctp_conninput(this, chunk->Data(), chunk->Length(), 0);
-  }
+// Called on the reactor for each decrypted packet
+void SCTPWrapper::RecvChunk(ChunkPtr chunk) {
+  SPDLOG_DEBUG(logger, "RecvChunk() Handling packet of len - {}", chunk->Length());
+  usrsctp_conninput(this, chunk->Data(), chunk->Length(), 0);
 }
 
 void SCTPWrapper::RunConnect() {
-  // Util::SetThreadName("SCTP-Connect");
   SPDLOG_TRACE(logger, "RunConnect() port={}", remote_port);
 
   struct sockaddr_conn sconn;
@@ -367,23 +367,20 @@ void SCTPWrapper::RunConnect() {
   sconn.sconn_len = sizeof((void *)this);
 #endif
 
-  // Blocks until connection succeeds/fails
+  // Only start the association here, the handshake completes as packets come in on the reactor
+  usrsctp_set_non_blocking(sock, 1);
   int connect_result = usrsctp_connect(sock, (struct sockaddr *)&sconn, sizeof sconn);
+  int connect_errno = errno;
+  usrsctp_set_non_blocking(sock, 0);
 
-  if ((connect_result < 0) && (errno != EINPROGRESS)) {
-    SPDLOG_DEBUG(logger, "Connection failed. errno={}", errno);
+  if ((connect_result < 0) && (connect_errno != EINPROGRESS)) {
+    SPDLOG_DEBUG(logger, "Connection failed. errno={}", connect_errno);
     should_stop = true;
 
-    {
-      // Unblock the recv thread
-      unique_lock<mutex> l(connectMtx);
-      connectCV.notify_one();
-    }
-
     // TODO let the world know we failed :(
 
   } else {
-    SPDLOG_DEBUG(logger, "Connected on port {}", remote_port);
+    SPDLOG_DEBUG(logger, "Connecting on port {}", remote_port);
   }
 }
 }
@@ -0,0 +1,144 @@
+#include "rsakeypairpool.h"
+
+#include <functional>
+
+#include <QCryptographicHash>
+
+#ifdef __clang__
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+namespace {
+    class FunctionRunnable : public QRunnable
+    {
+    public:
+        FunctionRunnable(std::function<void()> f) : function(f) { }
+        void run() override {function();}
+
+    private:
+        std::function<void()> function;
+    };
+}
+
+RSAKeypairPool& RSAKeypairPool::Instance()
+{
+    static RSAKeypairPool pool;
+    return pool;
+}
+
+RSAKeypairPool::RSAKeypairPool() :
+    num_generating(0)
+{
+    qRegisterMetaType<RSAKeypair>();
+    generator_threads.setMaxThreadCount(1);
+}
+
+void RSAKeypairPool::Fill()
+{
+    QMutexLocker lock(&mutex);
+    StartGenerating();
+}
+
+void RSAKeypairPool::Take(QObject * receiver, const char * method)
+{
+    Waiter waiter = {receiver, method};
+
+    QMutexLocker lock(&mutex);
+    if (!keypairs.isEmpty()) {
+        Deliver(waiter, keypairs.takeFirst());
+    }
+    else {
+        waiters.append(waiter);
+    }
+
+    // Top back up, or make sure something is coming for the waiter
+    StartGenerating();
+}
+
+void RSAKeypairPool::Sign(const RSAKeypair& keypair, const QByteArray& plaintext, QObject * receiver, const char * method)
+{
+    Waiter waiter = {receiver, method};
+
+    QThreadPool::globalInstance()->start(new FunctionRunnable([keypair, plaintext, waiter]() {
+        QByteArray signature;
+        if (keypair.rsa) {
+            signature.resize(RSA_size(keypair.rsa.get()));
+            unsigned int signature_bytes = 0;
+
+            QByteArray hashed_plaintext = QCryptographicHash::hash(plaintext, QCryptographicHash::Sha256);
+            if (RSA_sign(NID_sha256, reinterpret_cast<const unsigned char*>(hashed_plaintext.constData()), hashed_plaintext.size(),
+                         reinterpret_cast<unsigned char*>(signature.data()), &signature_bytes, keypair.rsa.get()) == 1) {
+                signature.resize(signature_bytes);
+            }
+            else {
+                qDebug() << "RSAKeypairPool::Sign() - RSA_sign failed -" << ERR_get_error();
+                signature = QByteArray();
+            }
+        }
+
+        if (waiter.receiver) {
+            QMetaObject::invokeMethod(waiter.receiver.data(), waiter.method, Qt::QueuedConnection, Q_ARG(QByteArray, signature));
+        }
+    }));
+}
+
+int RSAKeypairPool::GetNumAvailable()
+{
+    QMutexLocker lock(&mutex);
+    return keypairs.size();
+}
+
+void RSAKeypairPool::StartGenerating()
+{
+    while (keypairs.size() + num_generating < POOL_SIZE + waiters.size()) {
+        ++num_generating;
+        generator_threads.start(new FunctionRunnable([this]() {
+            GenerateFinished(Generate());
+        }));
+    }
+}
+
+void RSAKeypairPool::GenerateFinished(const RSAKeypair& keypair)
+{
+    QMutexLocker lock(&mutex);
+    --num_generating;
+
+    if (!waiters.isEmpty()) {
+        Deliver(waiters.takeFirst(), keypair);
+    }
+    else if (!keypair.IsNull()) {
+        keypairs.append(keypair);
+    }
+
+    qDebug() << "RSAKeypairPool::GenerateFinished() - Keypairs available:" << keypairs.size() << "Waiting:" << waiters.size();
+}
+
+RSAKeypair RSAKeypairPool::Generate()
+{
+    RSAKeypair keypair;
+
+    RSAKeypairGenerator generator;
+    if (!generator.GenerateKeypair()) {
+        return keypair;
+    }
+
+    // Parsed once here, every signature made with this keypair uses the parsed key
+    const unsigned char * private_key_data = reinterpret_cast<const unsigned char *>(generator.GetPrivateKey().constData());
+    RSA * rsa = d2i_RSAPrivateKey(NULL, &private_key_data, generator.GetPrivateKey().size());
+    if (!rsa) {
+        qDebug() << "RSAKeypairPool::Generate() - Could not create RSA struct from private key";
+        return keypair;
+    }
+
+    keypair.public_key = generator.GetPublicKey();
+    keypair.private_key = generator.GetPrivateKey();
+    keypair.rsa = std::shared_ptr<RSA>(rsa, RSA_free);
+    return keypair;
+}
+
+void RSAKeypairPool::Deliver(const Waiter& waiter, const RSAKeypair& keypair)
+{
+    if (waiter.receiver) {
+        QMetaObject::invokeMethod(waiter.receiver.data(), waiter.method, Qt::QueuedConnection, Q_ARG(RSAKeypair, keypair));
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef RSAKEYPAIRPOOL_H
+#define RSAKEYPAIRPOOL_H
+
+#include <memory>
+
+#include <QObject>
+#include <QMutex>
+#include <QPointer>
+#include <QThreadPool>
+
+#include "rsakeypairgenerator.h"
+
+// A generated keypair, with the private key already parsed so signing never goes back to the DER
+struct RSAKeypair
+{
+    QByteArray public_key;  // DER, uploaded to the metaverse
+    QByteArray private_key; // DER
+    std::shared_ptr<RSA> rsa;
+
+    bool IsNull() const {return !rsa;}
+};
+
+Q_DECLARE_METATYPE(RSAKeypair)
+
+// Generating a 2048-bit keypair takes hundreds of milliseconds, far too long for a worker's event loop.
+// The pool keeps POOL_SIZE keypairs generated ahead of time on its own thread, and signs on QThreadPool
+// threads. Results are queued back to the receiver's thread by calling the named slot.
+class RSAKeypairPool
+{
+public:
+    static const int POOL_SIZE = 2;
+
+    static RSAKeypairPool& Instance();
+
+    // Start generating, call at startup so the first authenticated user finds a keypair waiting
+    void Fill();
+
+    // Calls method(RSAKeypair) on receiver, straight away if the pool has one, once one is generated otherwise.
+    // A null keypair means generation failed.
+    void Take(QObject * receiver, const char * method);
+
+    // Calls method(QByteArray) on receiver with the SHA-256 RSA signature of plaintext, empty on failure
+    void Sign(const RSAKeypair& keypair, const QByteArray& plaintext, QObject * receiver, const char * method);
+
+    int GetNumAvailable();
+
+private:
+    struct Waiter
+    {
+        QPointer<QObject> receiver;
+        const char * method;
+    };
+
+    RSAKeypairPool();
+
+    // Called with mutex held
+    void StartGenerating();
+    void GenerateFinished(const RSAKeypair& keypair);
+
+    static RSAKeypair Generate();
+    static void Deliver(const Waiter& waiter, const RSAKeypair& keypair);
+
+    QMutex mutex;
+    QList<RSAKeypair> keypairs;
+    QList<Waiter> waiters;
+    int num_generating;
+
+    // One thread, so a burst of logins cannot take every core away from the workers
+    QThreadPool generator_threads;
+};
+
+#endif // RSAKEYPAIRPOOL_H
@@ -0,0 +1,13 @@
+#include "signalingserver.h"
+
+SignalingServer::SignalingServer(QObject * parent) :
+    QTcpServer(parent)
+{
+
+}
+
+void SignalingServer::incomingConnection(qintptr socket_descriptor)
+{
+    // No QTcpSocket is created here, the worker wraps the descriptor on its own thread
+    Q_EMIT ConnectionAccepted(socket_descriptor);
+}
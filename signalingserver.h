@@ -0,0 +1,25 @@
+#ifndef SIGNALINGSERVER_H
+#define SIGNALINGSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+
+// Listens for signaling clients on the main thread but hands each one over as a bare socket descriptor.
+// A QWebSocket from QWebSocketServer::nextPendingConnection() may only be used on the thread that accepted it,
+// so the WebSocket handshake is done by the worker that will own the connection instead.
+class SignalingServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    SignalingServer(QObject * parent = nullptr);
+
+Q_SIGNALS:
+
+    void ConnectionAccepted(qintptr socket_descriptor);
+
+protected:
+    void incomingConnection(qintptr socket_descriptor) override;
+};
+
+#endif // SIGNALINGSERVER_H
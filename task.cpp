@@ -2,26 +2,44 @@
 
 Task::Task(QObject * parent) :
     QObject(parent),
-    signaling_server_port(8118)
+    signaling_server_port(8118),
+    num_workers(QThread::idealThreadCount()),
+    stun_probe_socket(nullptr),
+    stun_probe_timer(nullptr),
+    num_stun_probes(0)
 {
     Utils::SetupTimestamp();
     Utils::SetupProtocolVersionSignature();
+    // Computed lazily otherwise, do it once here before connections on several workers ask for it
+    Utils::GetMachineFingerprint();
 
-    signaling_server = new QWebSocketServer(QStringLiteral("Signaling Server"), QWebSocketServer::NonSecureMode, this);
+    // Created here so its lookups run on the main thread, and started early so the servers have
+    // resolved by the time the first client arrives
+    HostResolverCache& resolver = HostResolverCache::Instance();
+    resolver.AddHost(HIFI_STUN_SERVER_HOSTNAME);
+    resolver.AddHost(HIFI_ICE_SERVER_HOSTNAME);
+    resolver.AddHost(WEBRTC_STUN_SERVER_HOSTNAME);
 
-    if (signaling_server->listen(QHostAddress::Any, signaling_server_port)) {
-        connect(signaling_server, &QWebSocketServer::newConnection, this, &Task::Connect);
-        connect(signaling_server, &QWebSocketServer::closed, this, &Task::Disconnect);
-    }
+    // Keypairs for username signatures are generated in the background, long before anyone needs one
+    RSAKeypairPool::Instance().Fill();
+
+    // Created here so it rotates on the main thread
+    CertificateStore::Instance();
+
+    // Only accepts, the WebSocket handshake runs on the worker the connection is assigned to
+    signaling_server = new SignalingServer(this);
 }
 
 Task::~Task()
 {
-    for (int i = 0; i < hifi_connections.size(); i++)
+    for (int i = 0; i < workers.size(); i++)
     {
-        hifi_connections[i]->Stop();
-        hifi_connections[i]->disconnect();
-        delete hifi_connections[i];
+        // Connections have to be torn down on the thread that owns their sockets
+        QMetaObject::invokeMethod(workers[i], "StopConnections", Qt::BlockingQueuedConnection);
+        worker_threads[i]->quit();
+        worker_threads[i]->wait();
+        delete workers[i];
+        delete worker_threads[i];
     }
     signaling_server->close();
 }
@@ -35,8 +53,24 @@ void Task::ProcessCommandLineArguments(int argc, char * argv[])
             Utils::SetDefaultIceServerPort(QString(argv[i+2]).toInt());
             i+=2;
         }
+        else if (s.right(8) == "-workers" && i+1 < argc) {
+            num_workers = qMax(1, QString(argv[i+1]).toInt());
+            i+=1;
+        }
+        else if (s.right(8) == "-resolve" && i+2 < argc) {
+            HostResolverCache::Instance().SetOverride(QString(argv[i+1]), QHostAddress(QString(argv[i+2])));
+            i+=2;
+        }
+        else if (s.right(14) == "-publicaddress" && i+1 < argc) {
+            configured_public_address = QHostAddress(QString(argv[i+1]));
+            i+=1;
+        }
+        else if (s.right(12) == "-certificate" && i+2 < argc) {
+            CertificateStore::Instance().SetCertificateFiles(QString(argv[i+1]), QString(argv[i+2]));
+            i+=2;
+        }
         else if (s.right(5) == "-help") {
-            qDebug() << "Usage: \n hifi_webrtc_relay [-iceserver address port] [-help]";
+            qDebug() << "Usage: \n hifi_webrtc_relay [-iceserver address port] [-workers count] [-resolve hostname address]... [-publicaddress address] [-certificate cert.pem key.pem] [-help]";
 
             // Just exit after displaying this help message
             exit(0);
@@ -48,17 +82,136 @@ void Task::run()
 {
     qDebug() << "Task::run() - Started HiFi WebRTC Relay";
 
+    if (!CertificateStore::Instance().Start()) {
+        qWarning() << "Task::run() - No DTLS certificate, peers will each generate their own";
+    }
+
+    StartWorkers();
+    StartStunProbe();
+
+    if (signaling_server->listen(QHostAddress::Any, signaling_server_port)) {
+        connect(signaling_server, &SignalingServer::ConnectionAccepted, this, &Task::Connect);
+    }
+
     // Application runs indefinitely (until terminated - e.g. Ctrl+C)
     //    Q_EMIT finished();
 }
 
-void Task::Connect()
+void Task::StartWorkers()
 {
-    QWebSocket *s = signaling_server->nextPendingConnection();
+    for (int i = 0; i < num_workers; i++) {
+        QThread * thread = new QThread();
+        thread->setObjectName(QString("ConnectionWorker%1").arg(i));
 
-    HifiConnection * h = new HifiConnection(s);
-    connect(h, SIGNAL(Disconnected()), this, SLOT(DisconnectHifiConnection()), Qt::QueuedConnection);
-    hifi_connections.push_back(h);
+        ConnectionWorker * worker = new ConnectionWorker(i);
+        worker->moveToThread(thread);
+        thread->start();
+
+        worker_threads.push_back(thread);
+        workers.push_back(worker);
+    }
+
+    qDebug() << "Task::StartWorkers() - Started" << num_workers << "connection workers";
+}
+
+void Task::StartStunProbe()
+{
+    if (configured_public_address.isNull()) {
+        return;
+    }
+
+    qDebug() << "Task::StartStunProbe() - Checking static public address" << configured_public_address << "against" << HIFI_STUN_SERVER_HOSTNAME;
+
+    // Connections keep using STUN until the probe has confirmed the configured address
+    stun_probe_socket = new QUdpSocket(this);
+    stun_probe_socket->bind(QHostAddress::AnyIPv4, 0);
+    connect(stun_probe_socket, &QUdpSocket::readyRead, this, &Task::StunProbeReadyRead);
+
+    stun_probe_timer = new QTimer(this);
+    connect(stun_probe_timer, &QTimer::timeout, this, &Task::SendStunProbe);
+    stun_probe_timer->start(HIFI_INITIAL_UPDATE_INTERVAL_MSEC);
+    SendStunProbe();
+}
+
+void Task::SendStunProbe()
+{
+    if (num_stun_probes == HIFI_NUM_INITIAL_REQUESTS_BEFORE_FAIL) {
+        qWarning() << "Task::SendStunProbe() - No STUN response, cannot confirm static public address" << configured_public_address
+                   << ", falling back to STUN for every connection";
+        FinishStunProbe();
+        return;
+    }
+    ++num_stun_probes;
+
+    const QHostAddress stun_server_address = HostResolverCache::Instance().GetAddress(HIFI_STUN_SERVER_HOSTNAME);
+    if (stun_server_address.isNull()) {
+        return;
+    }
+
+    const QByteArray request = Utils::CreateStunRequest();
+    stun_probe_socket->writeDatagram(request, stun_server_address, HIFI_STUN_SERVER_PORT);
+}
+
+void Task::StunProbeReadyRead()
+{
+    while (stun_probe_socket && stun_probe_socket->hasPendingDatagrams()) {
+        QByteArray datagram(stun_probe_socket->pendingDatagramSize(), 0);
+        stun_probe_socket->readDatagram(datagram.data(), datagram.size());
+
+        QHostAddress mapped_address;
+        quint16 mapped_port = 0;
+        if (!Utils::ParseStunResponse(datagram.constData(), datagram.size(), mapped_address, mapped_port)) {
+            continue;
+        }
+
+        const quint16 local_port = stun_probe_socket->localPort();
+        if (mapped_address == configured_public_address && mapped_port == local_port) {
+            qDebug() << "Task::StunProbeReadyRead() - Confirmed static public address" << configured_public_address << ", connections skip STUN";
+            Utils::SetStaticPublicAddress(configured_public_address);
+        }
+        else {
+            // A NAT or a wrong address, clients would be handed an address nobody can reach
+            qWarning() << "Task::StunProbeReadyRead() - STUN server sees" << mapped_address << mapped_port << "instead of" << configured_public_address << local_port
+                       << ", falling back to STUN for every connection";
+        }
+
+        FinishStunProbe();
+        return;
+    }
+}
+
+void Task::FinishStunProbe()
+{
+    stun_probe_timer->stop();
+    stun_probe_timer->deleteLater();
+    stun_probe_timer = nullptr;
+
+    stun_probe_socket->close();
+    stun_probe_socket->deleteLater();
+    stun_probe_socket = nullptr;
+}
+
+ConnectionWorker * Task::GetLeastLoadedWorker()
+{
+    ConnectionWorker * least_loaded = workers.first();
+    for (int i = 1; i < workers.size(); i++) {
+        if (workers[i]->GetNumConnections() < least_loaded->GetNumConnections()) {
+            least_loaded = workers[i];
+        }
+    }
+    return least_loaded;
+}
+
+void Task::Connect(qintptr socket_descriptor)
+{
+    ConnectionWorker * worker = GetLeastLoadedWorker();
+    worker->AssignConnection(socket_descriptor);
+
+    QStringList load;
+    for (int i = 0; i < workers.size(); i++) {
+        load << QString::number(workers[i]->GetNumConnections());
+    }
+    qDebug() << "Task::Connect() - Assigned connection to worker" << worker->GetId() << "Connections per worker:" << load.join(" ");
 }
 
 void Task::Disconnect()
@@ -75,15 +228,3 @@ void Task::ServerDisconnected()
 {
     //qDebug() << "Task::ServerDisconnected()";
 }
-
-void Task::DisconnectHifiConnection()
-{
-    HifiConnection *s = qobject_cast<HifiConnection *>(sender());
-    if (hifi_connections.contains(s)) {
-        hifi_connections.removeAll(s);
-        qDebug() << "Task::DisconnectHifiConnection()" << s;
-        s->Stop();
-        s->disconnect();
-        //s->deleteLater();
-    }
-}
@@ -26,6 +26,11 @@
 #include "node.h"
 #include "utils.h"
 #include "hificonnection.h"
+#include "connectionworker.h"
+#include "hostresolvercache.h"
+#include "rsakeypairpool.h"
+#include "certificatestore.h"
+#include "signalingserver.h"
 
 #include "portableendian.h"
 
@@ -46,12 +51,13 @@ public Q_SLOTS:
 
     void run();
 
-    void Connect();
+    void Connect(qintptr socket_descriptor);
     void Disconnect();
     void ServerConnected();
     void ServerDisconnected();
 
-    void DisconnectHifiConnection();
+    void SendStunProbe();
+    void StunProbeReadyRead();
 
 Q_SIGNALS:
 
@@ -59,9 +65,23 @@ Q_SIGNALS:
 
 private:
 
-    quint16 signaling_server_port;
-    QWebSocketServer * signaling_server;
+    void StartWorkers();
+    void StartStunProbe();
+    void FinishStunProbe();
+    ConnectionWorker * GetLeastLoadedWorker();
 
-    QList<HifiConnection *> hifi_connections;
+    quint16 signaling_server_port;
+    SignalingServer * signaling_server;
+
+    int num_workers;
+    QList<QThread *> worker_threads;
+    QList<ConnectionWorker *> workers;
+
+    // Startup check that -publicaddress really is what the STUN server sees,
+    // connections only skip STUN once it has confirmed the address
+    QHostAddress configured_public_address;
+    QUdpSocket * stun_probe_socket;
+    QTimer * stun_probe_timer;
+    int num_stun_probes;
 };
 #endif // TASK_H
@@ -32,7 +32,18 @@ function iceCallback(event) {
 }
 
 function relayMessage(event) {
-    console.log('relay message ' + event.data + '\n');
+    var data = new Uint8Array(event.data);
+    if (data.length > 0 && data[0] === 0) {
+        // Framed message: [0x00] then ([node type][16 bit big endian length][datagram])...
+        var position = 1;
+        while (position + 3 <= data.length) {
+            var length = (data[position + 1] << 8) | data[position + 2];
+            console.log('relay message from ' + String.fromCharCode(data[position]) + ' of size ' + length + '\n');
+            position += 3 + length;
+        }
+    } else {
+        console.log('relay message ' + event.data + '\n');
+    }
     //datachannel.send(event.data);
 }
 
@@ -50,6 +61,9 @@ signalServer.onmessage = function (event) {
             };
             signalServer.send(JSON.stringify(m));
 
+            //Ask the relay to coalesce server packets into framed messages
+            signalServer.send(JSON.stringify({type: 'framing'}));
+
             id = msg.id;
             console.log('node id ' + id);
 
@@ -68,6 +82,7 @@ signalServer.onmessage = function (event) {
             console.log('Created local peer connection object localConnection');
 
             datachannel = localConnection.createDataChannel('datachannel', dataConstraint);
+            datachannel.binaryType = 'arraybuffer';
             datachannel.onmessage = relayMessage;
 
             console.log('Created send data channel');
@@ -101,6 +116,9 @@ signalServer.onmessage = function (event) {
               }
             });
             break;
+        case 'framing':
+            console.log("framing enabled, max message size " + msg.max_message_size);
+            break;
         default:
             console.log("unknown websocket message type");
             break;
@@ -19,6 +19,7 @@ QElapsedTimer Utils::timestamp_timer = QElapsedTimer();
 
 QHostAddress Utils::default_ice_server_address = QHostAddress();
 quint16 Utils::default_ice_server_port = 7337;
+QAtomicInteger<quint32> Utils::static_public_ipv4(0);
 
 Utils::Utils()
 {
@@ -50,6 +51,83 @@ void Utils::SetDefaultIceServerPort(quint16 p)
     default_ice_server_port = p;
 }
 
+QHostAddress Utils::GetStaticPublicAddress()
+{
+    const quint32 ipv4 = static_public_ipv4.load();
+    return (ipv4 != 0) ? QHostAddress(ipv4) : QHostAddress();
+}
+
+void Utils::SetStaticPublicAddress(QHostAddress a)
+{
+    static_public_ipv4.store(a.toIPv4Address());
+}
+
+QByteArray Utils::CreateStunRequest()
+{
+    QByteArray request(NUM_BYTES_STUN_HEADER, 0);
+    char * data = request.data();
+
+    // leading zeros + message type, message length (no additional attributes are included)
+    qToBigEndian<quint16>(STUN_BINDING_REQUEST, reinterpret_cast<uchar *>(data));
+    qToBigEndian<quint16>(0, reinterpret_cast<uchar *>(data + 2));
+    qToBigEndian<quint32>(RFC_5389_MAGIC_COOKIE, reinterpret_cast<uchar *>(data + 4));
+
+    // transaction ID (random 12-byte unsigned integer)
+    memcpy(data + 8, QUuid::createUuid().toRfc4122().constData(), NUM_BYTES_STUN_TRANSACTION_ID);
+    return request;
+}
+
+QByteArray Utils::CreateStunResponse(const QHostAddress& address, quint16 port)
+{
+    const int NUM_BYTES_XOR_MAPPED_ADDRESS = 8;
+    QByteArray response(NUM_BYTES_STUN_HEADER + NUM_BYTES_STUN_ATTRIBUTE_HEADER + NUM_BYTES_XOR_MAPPED_ADDRESS, 0);
+    uchar * data = reinterpret_cast<uchar *>(response.data());
+
+    qToBigEndian<quint16>(STUN_BINDING_SUCCESS_RESPONSE, data);
+    qToBigEndian<quint16>(NUM_BYTES_STUN_ATTRIBUTE_HEADER + NUM_BYTES_XOR_MAPPED_ADDRESS, data + 2);
+    qToBigEndian<quint32>(RFC_5389_MAGIC_COOKIE, data + 4);
+    memcpy(data + 8, QUuid::createUuid().toRfc4122().constData(), NUM_BYTES_STUN_TRANSACTION_ID);
+
+    uchar * attribute = data + NUM_BYTES_STUN_HEADER;
+    qToBigEndian<quint16>(STUN_XOR_MAPPED_ADDRESS, attribute);
+    qToBigEndian<quint16>(NUM_BYTES_XOR_MAPPED_ADDRESS, attribute + 2);
+    attribute[5] = STUN_IPV4_FAMILY;
+    qToBigEndian<quint16>(port ^ (RFC_5389_MAGIC_COOKIE >> 16), attribute + 6);
+    qToBigEndian<quint32>(address.toIPv4Address() ^ RFC_5389_MAGIC_COOKIE, attribute + 8);
+    return response;
+}
+
+bool Utils::HasStunMagicCookie(const char * data, int size)
+{
+    return size >= NUM_BYTES_STUN_HEADER && qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data + 4)) == RFC_5389_MAGIC_COOKIE;
+}
+
+bool Utils::ParseStunResponse(const char * data, int size, QHostAddress& address, quint16& port)
+{
+    if (!HasStunMagicCookie(data, size)) {
+        return false;
+    }
+
+    // enumerate the attributes to find XOR_MAPPED_ADDRESS
+    const uchar * bytes = reinterpret_cast<const uchar *>(data);
+    int attribute_start_index = NUM_BYTES_STUN_HEADER;
+    while (attribute_start_index + NUM_BYTES_STUN_ATTRIBUTE_HEADER <= size) {
+        const quint16 attribute_type = qFromBigEndian<quint16>(bytes + attribute_start_index);
+        const quint16 attribute_length = qFromBigEndian<quint16>(bytes + attribute_start_index + 2);
+        const uchar * value = bytes + attribute_start_index + NUM_BYTES_STUN_ATTRIBUTE_HEADER;
+
+        if (attribute_type == STUN_XOR_MAPPED_ADDRESS && attribute_length >= 8 && value + 8 <= bytes + size && value[1] == STUN_IPV4_FAMILY) {
+            port = qFromBigEndian<quint16>(value + 2) ^ (RFC_5389_MAGIC_COOKIE >> 16);
+            address = QHostAddress(qFromBigEndian<quint32>(value + 4) ^ RFC_5389_MAGIC_COOKIE);
+            return true;
+        }
+
+        // attributes are padded to a multiple of 4 bytes
+        attribute_start_index += NUM_BYTES_STUN_ATTRIBUTE_HEADER + ((attribute_length + 3) & ~3);
+    }
+    return false;
+}
+
 void Utils::SetupTimestamp()
 {
     TIMESTAMP_REF = QDateTime::currentMSecsSinceEpoch() * 1000;
@@ -82,10 +160,10 @@ void Utils::SetupProtocolVersionSignature()
 {
     QByteArray buffer;
     QDataStream stream(&buffer, QIODevice::WriteOnly);
-    uint8_t number_of_protocols = static_cast<uint8_t>(PacketType::NUM_PACKET_TYPE) - PacketTypeEnum::GetProxiedPackets().size();
+    uint8_t number_of_protocols = static_cast<uint8_t>(PacketType::NUM_PACKET_TYPE) - PacketTypeInfo::NUM_PROXIED_PACKETS;
     stream << number_of_protocols;
     for (uint8_t packet_type = 0; packet_type < static_cast<uint8_t>(PacketType::NUM_PACKET_TYPE); packet_type++) {
-        if (!PacketTypeEnum::GetProxiedPackets().contains(static_cast<PacketType>(packet_type))) {
+        if (!PacketTypeInfo::IsProxied(static_cast<PacketType>(packet_type))) {
             uint8_t packet_type_version = static_cast<uint8_t>(VersionForPacketType(static_cast<PacketType>(packet_type)));
             stream << packet_type_version;
         }
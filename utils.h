@@ -5,11 +5,24 @@
 #include <QCryptographicHash>
 #include <QDataStream>
 #include <QtNetwork>
+#include <QtEndian>
 
 #include "packet.h"
 
 const uint32_t RFC_5389_MAGIC_COOKIE = 0x2112A442;
 const int NUM_BYTES_STUN_HEADER = 20;
+const int NUM_BYTES_STUN_TRANSACTION_ID = 12;
+const int NUM_BYTES_STUN_ATTRIBUTE_HEADER = 4;
+const quint16 STUN_BINDING_REQUEST = 0x0001;
+const quint16 STUN_BINDING_SUCCESS_RESPONSE = 0x0101;
+const quint16 STUN_XOR_MAPPED_ADDRESS = 0x0020;
+const quint8 STUN_IPV4_FAMILY = 0x01;
+
+const char * const HIFI_STUN_SERVER_HOSTNAME = "stun.highfidelity.io";
+const quint16 HIFI_STUN_SERVER_PORT = 3478;
+const char * const HIFI_ICE_SERVER_HOSTNAME = "ice.highfidelity.com"; //"dev-ice.highfidelity.com";
+const char * const WEBRTC_STUN_SERVER_HOSTNAME = "stun.l.google.com";
+const quint16 WEBRTC_STUN_SERVER_PORT = 19302;
 
 const quint16 DEFAULT_DOMAIN_SERVER_PORT = 40102;
 const int HIFI_INITIAL_UPDATE_INTERVAL_MSEC = 500;
@@ -38,11 +51,24 @@ public:
     static quint16 GetDefaultIceServerPort();
     static void SetDefaultIceServerPort(quint16 p);
 
+    // Set once the startup probe has confirmed the -publicaddress of a host that does not remap ports,
+    // connections then skip STUN. Null when discovery through STUN is needed.
+    static QHostAddress GetStaticPublicAddress();
+    static void SetStaticPublicAddress(QHostAddress a);
+
+    // RFC 5389 binding request/response with an IPv4 XOR-MAPPED-ADDRESS, the only parts of STUN we use
+    static QByteArray CreateStunRequest();
+    static QByteArray CreateStunResponse(const QHostAddress& address, quint16 port);
+    static bool HasStunMagicCookie(const char * data, int size);
+    // False unless data carries an IPv4 XOR-MAPPED-ADDRESS
+    static bool ParseStunResponse(const char * data, int size, QHostAddress& address, quint16& port);
+
 private:
     static QString GetMachineFingerprintString();
 
     static QHostAddress default_ice_server_address;
     static quint16 default_ice_server_port;
+    static QAtomicInteger<quint32> static_public_ipv4; // read by every worker, set by the startup probe
 
     static QByteArray protocol_version_signature;
     static QString protocol_version_signature_base64;